@@ -15,6 +15,19 @@
 #include <Arduino.h>
 #include "libraries/drv/drv.h"
 #include "libraries/drv/drv.cpp"
+#include "libraries/drvScheduler/drvScheduler.h"
+#include "libraries/drvScheduler/drvScheduler.cpp"
+#include "libraries/drvTelemetry/drvTelemetry.h"
+#include "libraries/drvTelemetry/drvTelemetry.cpp"
+#include "libraries/drvRamp/drvRamp.h"
+#include "libraries/drvRamp/drvRamp.cpp"
+
+// define DRV_BENCH to print the drv microbenchmark table at boot
+#ifdef DRV_BENCH
+#include "libraries/drvBench/drvBench.h"
+#include "libraries/drvBench/drvBench.cpp"
+#endif
+
 #define MOSI 11 
 #define MISO 12 
 #define CLK 13
@@ -27,35 +40,104 @@
  // initialize drv object
 drv sailboat(MOSI, MISO, CLK, SCS);
 
+// boot configuration, checked at compile time and kept in flash
+constexpr DrvProfile sailboatProfile PROGMEM = {
+    false, 40, 410,           // bridge off, ISGAIN 40 V/V, DTIME 410 ns
+    0x70,                     // TORQUE
+    48, 128,                  // TOFF, TBLANK
+    16, drvFields::DECAY_SLOW, // TDECAY, DECMOD
+    500, 2100,                // OCPTH 500 mV, OCPDEG 2.1 us
+    1050, 1050, 400, 200      // TDRIVEN/P 1050 ns, IDRIVEN 400 mA, IDRIVEP 200 mA
+};
+static_assert(drvProfileValid(sailboatProfile), "sailboatProfile out of range");
+
+// fixed-rate control loop, 1 ms ticks
+drvScheduler scheduler;
+
+// binary snapshots of the driver, tools/telemetry turns them into CSV
+drvTelemetry telemetry(sailboat, logger);
+
+// TORQUE moves to the setpoint along an S-curve, one frame per step
+drvRamp ramp(sailboat, 1000);
+
+// torque command, ramped to by the 1 kHz task when it changes
+volatile unsigned char torqueSetpoint = 0x70;
+
+void torqueTask(void* context) {
+  if (torqueSetpoint != ramp.target()) {
+    ramp.setTarget(torqueSetpoint, 200, drvRamp::RAMP_SCURVE); // 200 steps/s on average
+  }
+  ramp.tick();
+}
+
+// printTask sends the table a few columns at a time, never waiting on Serial
+void statsTask(void* context) {
+  scheduler.beginPrint();
+}
+
+// print what led up to a fault, journalTask sends it an entry at a time
+void onFault(drv& device, unsigned char faults, unsigned char raised) {
+  device.beginJournalDump();
+}
+
+// the bus can't be trusted to turn the bridge off, nSLEEP can
+void onBusFailure(drv& device) {
+  device.sleep();
+}
+
 void setup(){
   Serial.begin(9600);
 
   pinMode(SCS, OUTPUT); pinMode(MOSI, OUTPUT); pinMode(MISO, OUTPUT); pinMode(CLK, OUTPUT);
   pinMode(FAULT, INPUT);
-  pinMode(SLEEP, OUTPUT);
   pinMode(10, OUTPUT);
 
-  digitalWrite(SLEEP, HIGH);
+  // nSLEEP high, sailboat.sleep()/wake() idle the driver between duty cycles
+  sailboat.setSleepPin(SLEEP);
   digitalWrite(SCS, LOW); 
   // run diagnostic 
   sailboat.setLogging("info");
+  // records queue in the ring buffer instead of blocking on Serial, logTask
+  // drains it, tools/logdecode prints them (the stats table stays text)
+  logger.setTransport(LOG_BINARY);
+  // setters trust the register shadow unless the driver reports a fault
+  sailboat.setVerifyPolicy(drv::VERIFY_ON_FAULT, 1, FAULT);
+  // retry bad frames twice, read back one write in 8, sleep the chip if the bus dies
+  sailboat.setReliability(2, 20, 8);
+  sailboat.onBusFailure(onBusFailure);
+  // clear over current faults as soon as they are reported
+  sailboat.beginFaultMonitor(FAULT, onFault, drv::FAULT_AOCP | drv::FAULT_BOCP);
   // sailboat.regDiagnostic(sailboat.initRegs);
   // sailboat.read(sailboat.CTRL);
-  // sailboat.setHbridge("on");
-  // sailboat.setISGain(10); 
-  delay(50);
-  sailboat.setTorque(0x70);
+  // sailboat.setHbridge(Bridge::On);
+  // sailboat.setISGain(ISGain::V10);
   delay(50);
-  sailboat.setHbridge("off");
-  sailboat.setTorque(0x70);
+  // only the registers that differ from the chip are written
+  sailboat.applyProfile_P(&sailboatProfile);
+  // bridge is off, find the fastest reliable SPI clock
+  sailboat.autoTuneClock();
+#ifdef DRV_BENCH
+  drvBench bench(sailboat, logger);
+  drvBench::printHeader();
+  bench.run("board");
+#endif
+
+  ramp.begin();
+  scheduler.add(torqueTask, 1000);                                 // 1 kHz, the ramp's tick
+  scheduler.add(drvScheduler::faultTask, 10000, &sailboat);        // STATUS at 100 Hz
+  telemetry.setRate(10);
+  telemetry.setScheduler(scheduler);
+  scheduler.add(drvTelemetry::task, 10000, &telemetry);            // sends at 10 Hz
+  scheduler.add(drvScheduler::logTask, 100000, &logger);           // 10 Hz
+  scheduler.add(statsTask, 10000000);                              // every 10 s
+  scheduler.add(drvScheduler::printTask, 20000, &scheduler);       // 50 Hz while printing
+  scheduler.add(drvScheduler::journalTask, 20000, &sailboat);      // fault dumps, last so lowest priority
 
     
 }
 
 void loop(){
-  Serial.println(sailboat.getTorque());
-  //delay(250);
-  
+  scheduler.run();
 }
 
 
@@ -7,8 +7,8 @@
 
     Usage:
     initialize a Logger object:
-    Logger logger(char* level);
-    logger.setLevel(error/info/off);
+    Logger logger(char* tag, LOG_INFO);
+    logger.setLevel(LOG_ERROR/LOG_INFO/LOG_OFF);
     logger.logi("info message");
     logger.loge("error message");
 
@@ -17,143 +17,276 @@
 #include"Logger.h"
 
 
-Logger::Logger(char* tagg, char* level) {
+Logger::Logger(char* tagg, LogLevel level, unsigned char tagId) : tagId(tagId) {
     tag = tagg;
+    _tagInFlash = false;
+    lvl = level;
+    dropped = 0;
+    bytesLogged = 0;
+    _transport = LOG_TEXT;
+    _dictionary = NULL;
+    _head = 0;
+    _tail = 0;
+}
+
+Logger::Logger(const __FlashStringHelper* tagg, LogLevel level, unsigned char tagId) : tagId(tagId) {
+    tag = (char*)tagg;
+    _tagInFlash = true;
+    lvl = level;
+    dropped = 0;
+    bytesLogged = 0;
+    _transport = LOG_TEXT;
+    _dictionary = NULL;
+    _head = 0;
+    _tail = 0;
+}
+
+Logger::Logger(char* tagg, char* level) : tagId(0) {
+    tag = tagg;
+    _tagInFlash = false;
+    lvl = parseLevel(level);
+    dropped = 0;
+    bytesLogged = 0;
+    _transport = LOG_TEXT;
+    _dictionary = NULL;
+    _head = 0;
+    _tail = 0;
+}
+
+void Logger::setLevel(LogLevel level) {
     lvl = level;
 }
 
 void Logger::setLevel(char* level) {
-    if (level == "info") {
-        lvl = "info";
-    } else if (level == "error") {
-        lvl = "error";
-    } else if (level == "global") {
-        lvl = "global";
+    lvl = parseLevel(level);
+}
+
+LogLevel Logger::parseLevel(char* level) {
+    if (strcmp_P(level, PSTR("info")) == 0) {
+        return LOG_INFO;
+    } else if (strcmp_P(level, PSTR("error")) == 0) {
+        return LOG_ERROR;
+    } else if (strcmp_P(level, PSTR("global")) == 0) {
+        return LOG_GLOBAL;
+    }
+    return LOG_OFF;
+}
+
+const __FlashStringHelper* Logger::levelName(LogLevel level) {
+    switch (level) {
+        case LOG_INFO: return F("info");
+        case LOG_ERROR: return F("error");
+        case LOG_GLOBAL: return F("global");
+        default: return F("off");
+    }
+}
+
+void Logger::setTransport(LogTransport transport) {
+    _transport = transport;
+}
+
+void Logger::setDictionary(const LogDictionary* dictionary) {
+    _dictionary = dictionary;
+}
+
+void Logger::print(LogLevel level, const char* message, bool flash) {
+    if (_transport == LOG_BINARY) {
+        unsigned char record[8];
+        unsigned char event = level == LOG_INFO ? LOG_EVENT_INFO :
+                              level == LOG_ERROR ? LOG_EVENT_ERROR : LOG_EVENT_GLOBAL;
+        size_t size = flash ? strlen_P(message) : strlen(message);
+        unsigned char length = size < LOG_MESSAGE_MAX ? size : LOG_MESSAGE_MAX;
+        unsigned char n = recordStart(record, event);
+        record[n++] = length;
+        push(record, n, message, length, flash);
+        return;
+    }
+
+    printTag();
+    bytesLogged += Serial.print(level == LOG_INFO ? F(" - INFO: ") :
+                 level == LOG_ERROR ? F(" - ERROR: ") : F(" - GLOBAL: "));
+    if (flash) {
+        bytesLogged += Serial.println((const __FlashStringHelper*)message);
+    } else {
+        bytesLogged += Serial.println(message);
+    }
+}
+
+void Logger::printTag() {
+    if (_tagInFlash) {
+        bytesLogged += Serial.print((const __FlashStringHelper*)tag);
     } else {
-        lvl = "off";
-    }
-}
-
-void Logger::logi(char* message) {
-    if (lvl == "info") {
-        Serial.print(tag);
-        Serial.print(" - INFO: ");
-        Serial.println(message);
-    }
-}
-
-void Logger::loge(char* message) {
-    if (lvl == "info" || lvl == "error") {
-        Serial.print(tag);
-        Serial.print(" - ERROR: ");
-        Serial.println(message);
-    }
-}
-
-void Logger::logg(char* message) {
-    if (lvl == "global" || lvl == "error" || lvl == "info") {
-        Serial.print(tag);
-        Serial.print(" - GLOBAL: ");
-        Serial.println(message);
-    }
-}
-
-bool Logger::logSet(char* reg, char* subreg, char* setting, bool success) {
-    
-    if (success && lvl == "info")  {
-        Serial.print(tag);
-        Serial.print(" - INFO: ");
-        Serial.print(reg);
-        Serial.print(" register, ");
-        Serial.print(subreg);
-        Serial.print(" subregister, ");
-        Serial.print(setting);
-        Serial.println(" write success");
-    } else if(!success && (lvl == "error" || lvl == "info")) {
-        Serial.print(tag);
-        Serial.print(" - ERROR: ");
-        Serial.print(reg);
-        Serial.print(" register, ");
-        Serial.print(subreg);
-        Serial.print(" subregister, ");
-        Serial.print(setting);
-        Serial.println(" write fail");
-    }
-
-    return success;
-}
-
-bool Logger::logSet(char* reg, char* subreg, int setting, bool success){
-     
-     if (success && lvl == "info")  {
-        Serial.print(tag);
-        Serial.print(" - INFO: ");
-        Serial.print(reg);
-        Serial.print(" register, ");
-        Serial.print(subreg);
-        Serial.print(" subregister, ");
-        Serial.print(setting);
-        Serial.println(" write success");
-    } else if(!success && (lvl == "error" || lvl == "info")) {
-        Serial.print(tag);
-        Serial.print(" - ERROR: ");
-        Serial.print(reg);
-        Serial.print(" register, ");
-        Serial.print(subreg);
-        Serial.print(" subregister, ");
-        Serial.print(setting);
-        Serial.println(" write fail");
-    }
-
-    return success;
-}
-
-bool Logger::logSet(char* reg, char* subreg, float setting, bool success){
-     
-     if (success && lvl == "info")  {
-        Serial.print(tag);
-        Serial.print(" - INFO: ");
-        Serial.print(reg);
-        Serial.print(" register, ");
-        Serial.print(subreg);
-        Serial.print(" subregister, ");
-        Serial.print(setting);
-        Serial.println(" write success");
-    } else if(!success && (lvl == "error" || lvl == "info")) {
-        Serial.print(tag);
-        Serial.print(" - ERROR: ");
-        Serial.print(reg);
-        Serial.print(" register, ");
-        Serial.print(subreg);
-        Serial.print(" subregister, ");
-        Serial.print(setting);
-        Serial.println(" write fail");
-    }
-
-    return success;
-}
-
-bool Logger::logSet(char* reg, char* subreg, unsigned int setting, bool success){
-     
-     if (success && lvl == "info")  {
-        Serial.print(tag);
-        Serial.print(" - INFO: ");
-        Serial.print(reg);
-        Serial.print(" register, ");
-        Serial.print(subreg);
-        Serial.print(" subregister, ");
-        Serial.print(setting);
-        Serial.println(" write success");
-    } else if(!success && (lvl == "error" || lvl == "info")) {
-        Serial.print(tag);
-        Serial.print(" - ERROR: ");
-        Serial.print(reg);
-        Serial.print(" register, ");
-        Serial.print(subreg);
-        Serial.print(" subregister, ");
-        Serial.print(setting);
-        Serial.println(" write fail");
-    }
-
-    return success;
+        bytesLogged += Serial.print(tag);
+    }
+}
+
+void Logger::printSet(unsigned char reg, unsigned char field, long value, LogFormat format, bool success) {
+    if (_transport == LOG_BINARY) {
+        unsigned char record[14];
+        unsigned char n = recordStart(record, success ? LOG_EVENT_SET : LOG_EVENT_SET_FAIL);
+        record[n++] = reg;
+        record[n++] = field;
+        record[n++] = format;
+        for (int i = 0; i < 4; i++) {
+            record[n++] = (value >> (8 * i)) & 0xFF;
+        }
+        push(record, n, NULL, 0);
+        return;
+    }
+
+    if (_dictionary == NULL) {
+        return;
+    }
+    printSetStart((const char*)pgm_read_ptr(&_dictionary->registers[reg]),
+                  (const char*)pgm_read_ptr(&_dictionary->fields[field]), success, true);
+    const char* const* names = (const char* const*)pgm_read_ptr(&_dictionary->values[field]);
+    if (format == LOG_NAME && names != NULL) {
+        bytesLogged += Serial.print((const __FlashStringHelper*)pgm_read_ptr(&names[value]));
+    } else if (format == LOG_MILLI) {
+        bytesLogged += Serial.print(value / 1000.0);
+    } else {
+        bytesLogged += Serial.print(value);
+    }
+    printSetEnd(success);
+}
+
+void Logger::printSetStart(const char* reg, const char* subreg, bool success, bool flash) {
+    printTag();
+    bytesLogged += Serial.print(success ? F(" - INFO: ") : F(" - ERROR: "));
+    if (flash) {
+        bytesLogged += Serial.print((const __FlashStringHelper*)reg);
+    } else {
+        bytesLogged += Serial.print(reg);
+    }
+    bytesLogged += Serial.print(F(" register, "));
+    if (flash) {
+        bytesLogged += Serial.print((const __FlashStringHelper*)subreg);
+    } else {
+        bytesLogged += Serial.print(subreg);
+    }
+    bytesLogged += Serial.print(F(" subregister, "));
+}
+
+void Logger::printSetEnd(bool success) {
+    bytesLogged += Serial.println(success ? F(" write success") : F(" write fail"));
+}
+
+void Logger::printRegister(unsigned long time, unsigned char reg, unsigned char source,
+                           unsigned int oldValue, unsigned int newValue) {
+    if (_transport == LOG_BINARY) {
+        unsigned char record[13];
+        unsigned char n = recordStart(record, LOG_EVENT_REGISTER);
+        for (int i = 0; i < 4; i++) {
+            record[2 + i] = (time >> (8 * i)) & 0xFF;
+        }
+        record[n++] = reg;
+        record[n++] = source;
+        record[n++] = oldValue & 0xFF;
+        record[n++] = oldValue >> 8;
+        record[n++] = newValue & 0xFF;
+        record[n++] = newValue >> 8;
+        push(record, n, NULL, 0);
+        return;
+    }
+
+    if (_dictionary == NULL) {
+        return;
+    }
+    // e.g. "DRV8704 - GLOBAL: CTRL register write by ENBL, 0x301 -> 0x300 at 1234 us"
+    printTag();
+    bytesLogged += Serial.print(F(" - GLOBAL: "));
+    bytesLogged += Serial.print((const __FlashStringHelper*)pgm_read_ptr(&_dictionary->registers[reg & 0x7]));
+    bytesLogged += Serial.print(reg & 0x80 ? F(" register read by ") : F(" register write by "));
+    bytesLogged += Serial.print((const __FlashStringHelper*)pgm_read_ptr(&_dictionary->sources[source]));
+    bytesLogged += Serial.print(F(", 0x"));
+    bytesLogged += Serial.print(oldValue, HEX);
+    bytesLogged += Serial.print(F(" -> 0x"));
+    bytesLogged += Serial.print(newValue, HEX);
+    bytesLogged += Serial.print(F(" at "));
+    bytesLogged += Serial.print(time);
+    bytesLogged += Serial.println(F(" us"));
+}
+
+bool Logger::logFrame(const unsigned char* data, unsigned char length) {
+    unsigned char record[8];
+    if (length > LOG_FRAME_MAX) {
+        dropped++;
+        return false;
+    }
+    unsigned char n = recordStart(record, LOG_EVENT_FRAME);
+    record[n++] = length;
+
+    if (_transport == LOG_BINARY) {
+        return push(record, n, (const char*)data, length);
+    }
+
+    // text lines are written whole, so a frame can't split one
+    if (Serial.availableForWrite() < n + length) {
+        dropped++;
+        return false;
+    }
+    bytesLogged += Serial.write(record, n);
+    bytesLogged += Serial.write(data, length);
+    return true;
+}
+
+unsigned char Logger::recordStart(unsigned char* record, unsigned char event) {
+    unsigned long now = micros();
+    record[0] = LOG_SYNC;
+    record[1] = event;
+    for (int i = 0; i < 4; i++) {
+        record[2 + i] = (now >> (8 * i)) & 0xFF;
+    }
+    record[6] = tagId;
+    return 7;
+}
+
+bool Logger::push(const unsigned char* header, unsigned char headerLength, const char* data, unsigned char dataLength, bool flash) {
+    /*
+    Copy a record in behind _head. Only this side moves _head, only drain()
+    moves _tail, so no locking is needed with a single producer.
+    */
+    unsigned char head = _head;
+    unsigned char used = (head - _tail) & (LOG_BUFFER_SIZE - 1);
+    unsigned int length = headerLength + dataLength;
+
+    if (length > (unsigned int)(LOG_BUFFER_SIZE - 1 - used)) {
+        dropped++;
+        return false;
+    }
+    bytesLogged += length;
+
+    for (unsigned char i = 0; i < headerLength; i++) {
+        _buffer[head] = header[i];
+        head = (head + 1) & (LOG_BUFFER_SIZE - 1);
+    }
+    for (unsigned char i = 0; i < dataLength; i++) {
+        _buffer[head] = flash ? pgm_read_byte(&data[i]) : data[i];
+        head = (head + 1) & (LOG_BUFFER_SIZE - 1);
+    }
+    _head = head; // publish the whole record at once
+
+    drain();
+    return true;
+}
+
+unsigned int Logger::drain() {
+    unsigned char tail = _tail;
+    unsigned char head = _head;
+    int room = Serial.availableForWrite();
+
+    while (tail != head && room > 0) {
+        // contiguous run up to the end of the buffer or the head
+        unsigned char end = head > tail ? head : 0;
+        unsigned int run = (end == 0 ? LOG_BUFFER_SIZE : end) - tail;
+        if (run > (unsigned int)room) {
+            run = room;
+        }
+        Serial.write(&_buffer[tail], run);
+        room -= run;
+        tail = (tail + run) & (LOG_BUFFER_SIZE - 1);
+    }
+    _tail = tail;
+
+    return (head - tail) & (LOG_BUFFER_SIZE - 1);
 }
@@ -7,10 +7,21 @@
 
     Usage:
     initialize a Logger object:
-    Logger logger(char* level);
-    logger.setLevel(error/info/off);
+    Logger logger(char* tag, LOG_INFO);
+    logger.setLevel(LOG_ERROR/LOG_INFO/LOG_OFF);
     logger.logi("info message");
-    logger.loge("error message");
+    logger.loge(F("error message")); // message stays in flash
+
+    Levels above LOG_MAX_LEVEL are compiled out, define it before including
+    Logger.h (or with -D) to strip messages from a build:
+    #define LOG_MAX_LEVEL LOG_ERROR
+
+    Binary transport:
+    logger.setTransport(LOG_BINARY);
+    messages become compact records (see LOG RECORDS below) queued in a
+    LOG_BUFFER_SIZE byte ring buffer, drain() writes as much of it as
+    Serial can take without blocking. Call it from loop() or an idle hook.
+    tools/logdecode turns the records back into text lines.
 
 */
 
@@ -19,43 +30,211 @@
 
 #include <Arduino.h>
 
+/*
+logging levels, each level includes the ones below it
+*/
+enum LogLevel {
+    LOG_OFF = 0,    // nothing
+    LOG_GLOBAL = 1, // only globals
+    LOG_ERROR = 2,  // errors and globals
+    LOG_INFO = 3    // all messages
+};
+
+#ifndef LOG_MAX_LEVEL
+#define LOG_MAX_LEVEL LOG_INFO
+#endif
+
+/*
+where messages go
+*/
+enum LogTransport {
+    LOG_TEXT,  // formatted lines, written straight to Serial
+    LOG_BINARY // records through the ring buffer
+};
+
+// ring buffer size in bytes, must be a power of two <= 256
+#ifndef LOG_BUFFER_SIZE
+#define LOG_BUFFER_SIZE 128
+#endif
+
+/*
+LOG RECORDS
+all multi byte values little endian
+
+set record (14 bytes):
+    LOG_SYNC, event (LOG_EVENT_SET/_SET_FAIL), timestamp (4, micros),
+    tag id, register, field, format (LogFormat), value (4)
+
+message record (8 bytes + message):
+    LOG_SYNC, event (LOG_EVENT_INFO/_ERROR/_GLOBAL), timestamp (4, micros),
+    tag id, length, message (length bytes, at most LOG_MESSAGE_MAX)
+
+register record (13 bytes):
+    LOG_SYNC, LOG_EVENT_REGISTER, timestamp (4, micros of the access),
+    tag id, register (bit 7 set for reads), source, old value (2), new value (2)
+
+frame record (8 bytes + data):
+    LOG_SYNC, LOG_EVENT_FRAME, timestamp (4, micros), tag id, length,
+    data (length bytes, at most LOG_FRAME_MAX) laid out by the subsystem
+    that sent it, its first byte says which (e.g. drvTelemetry)
+*/
+const unsigned char LOG_SYNC = 0xA5;
+const unsigned char LOG_MESSAGE_MAX = 40;
+const unsigned char LOG_FRAME_MAX = 64;
+
+enum LogEvent {
+    LOG_EVENT_SET = 1,
+    LOG_EVENT_SET_FAIL = 2,
+    LOG_EVENT_INFO = 3,
+    LOG_EVENT_ERROR = 4,
+    LOG_EVENT_GLOBAL = 5,
+    LOG_EVENT_REGISTER = 6,
+    LOG_EVENT_FRAME = 7
+};
+
+/*
+how the value of a set record is printed
+*/
+enum LogFormat {
+    LOG_INT = 0,   // as is
+    LOG_MILLI = 1, // value / 1000, 2 decimals
+    LOG_NAME = 2   // index into the field's value names
+};
+
+/*
+names used to print set records as text, indexed by the ids passed to logSet
+the tables and the names they point to live in flash (PROGMEM)
+*/
+struct LogDictionary {
+    const char* const* registers;
+    const char* const* fields;
+    const char* const* const* values; // per field, NULL if the field has no names
+    const char* const* sources;       // register access sources (see logRegister)
+};
+
 class Logger {
 
     public: 
      /*
-     initializes Serial communications (baud rate: 9600)
+     tagg: printed in front of every message
+     tagId: identifies the tag in binary records
      */
+     Logger(char* tagg, LogLevel level, unsigned char tagId = 0);
+     Logger(const __FlashStringHelper* tagg, LogLevel level, unsigned char tagId = 0);
+
      Logger(char* tagg, char* level);
 
      /*
      stores logging level
      */
-     char* lvl;
+     LogLevel lvl;
 
      char* tag;
 
+     unsigned char tagId;
+
+     /*
+     records that didn't fit in the ring buffer
+     */
+     unsigned int dropped;
+
+     /*
+     bytes of log output produced (text printed or records queued)
+     */
+     unsigned long bytesLogged;
+
      /*
      sets logging:
-     "off" - nothing except globals
-     "error" - only errors
+     "off" - nothing
+     "global" - only globals
+     "error" - errors and globals
      "info" - all messages
      */
+     void setLevel(LogLevel level);
+
      void setLevel(char* level);
 
+     /*
+     level for a name ("off", "global", "error", "info"), LOG_OFF if unknown
+     */
+     static LogLevel parseLevel(char* level);
+
+     /*
+     name of a level
+     */
+     static const __FlashStringHelper* levelName(LogLevel level);
+
+     /*
+     selects text or binary output (text by default)
+     */
+     void setTransport(LogTransport transport);
+
+     LogTransport transport() {
+        return _transport;
+     }
+
+     /*
+     sets the names used to print id based set messages as text
+     */
+     void setDictionary(const LogDictionary* dictionary);
+
+     /*
+     writes queued records to Serial without blocking
+     returns the number of bytes still queued
+     */
+     unsigned int drain();
+
+     /*
+     true if messages of level are compiled in and enabled
+     */
+     bool enabled(LogLevel level) {
+        return level <= LOG_MAX_LEVEL && level <= lvl;
+     }
+
      /*
      info log message
      */
-     void logi(char* message);
+     void logi(char* message) {
+        if (enabled(LOG_INFO)) {
+            print(LOG_INFO, message, false);
+        }
+     }
+
+     void logi(const __FlashStringHelper* message) {
+        if (enabled(LOG_INFO)) {
+            print(LOG_INFO, (const char*)message, true);
+        }
+     }
 
      /*
      error log message
      */
-     void loge(char* message);
+     void loge(char* message) {
+        if (enabled(LOG_ERROR)) {
+            print(LOG_ERROR, message, false);
+        }
+     }
+
+     void loge(const __FlashStringHelper* message) {
+        if (enabled(LOG_ERROR)) {
+            print(LOG_ERROR, (const char*)message, true);
+        }
+     }
 
      /*
      global log message
      */
-     void logg(char* message);
+     void logg(char* message) {
+        if (enabled(LOG_GLOBAL)) {
+            print(LOG_GLOBAL, message, false);
+        }
+     }
+
+     void logg(const __FlashStringHelper* message) {
+        if (enabled(LOG_GLOBAL)) {
+            print(LOG_GLOBAL, (const char*)message, true);
+        }
+     }
 
 
      // DRV Specific Functions
@@ -64,6 +243,8 @@ class Logger {
      logging for Setter functions of DRV
      if success : logs info - "TAG - reg register subreg setting write success"
      else : logs error - "TAG - reg register subreg setting write fail"
+     setting: anything Serial.print takes
+     text transport only, use the id based logSet for binary records
     
      Usage:
         bool success = drv.write(CTRL, value));
@@ -71,16 +252,91 @@ class Logger {
     
 
      */
-     bool logSet(char* reg, char* subreg, char* setting, bool success);
+     template <class T>
+     bool logSet(char* reg, char* subreg, T setting, bool success) {
+        if (_transport == LOG_TEXT && enabled(success ? LOG_INFO : LOG_ERROR)) {
+            printSetStart(reg, subreg, success, false);
+            bytesLogged += Serial.print(setting);
+            printSetEnd(success);
+        }
+        return success;
+     }
 
-     bool logSet(char* reg, char* subreg, int setting, bool success);
+     /*
+     id based logging for Setter functions, printed through the dictionary
+     reg, field: indexes into the dictionary
+     format: how value is printed (LogFormat)
+    
+     Usage:
+        logSet(CTRL, FIELD_ENBL, 1, LOG_NAME, success);
+     */
+     bool logSet(unsigned char reg, unsigned char field, long value, LogFormat format, bool success) {
+        if (enabled(success ? LOG_INFO : LOG_ERROR)) {
+            printSet(reg, field, value, format, success);
+        }
+        return success;
+     }
+
+     /*
+     logs a recorded register access (global level), e.g. from drv's journal
+     time: micros of the access
+     reg: register address, bit 7 set for a read
+     source: index into the dictionary's sources
+     */
+     void logRegister(unsigned long time, unsigned char reg, unsigned char source,
+                      unsigned int oldValue, unsigned int newValue) {
+        if (enabled(LOG_GLOBAL)) {
+            printRegister(time, reg, source, oldValue, newValue);
+        }
+     }
+
+     /*
+     sends another subsystem's binary data as a frame record, whatever the
+     level. Binary transport queues it behind the other records, text
+     transport writes it straight to Serial, in both cases whole and
+     without blocking.
+     returns false if it was dropped (no room or longer than LOG_FRAME_MAX)
+     */
+     bool logFrame(const unsigned char* data, unsigned char length);
+
+    private:
+
+     LogTransport _transport;
+     const LogDictionary* _dictionary;
 
-     bool logSet(char* reg, char* subreg, float setting, bool success);
+     // single producer (logging calls), single consumer (drain)
+     unsigned char _buffer[LOG_BUFFER_SIZE];
+     volatile unsigned char _head;
+     volatile unsigned char _tail;
 
-     bool logSet(char* reg, char* subreg, unsigned int setting, bool success);
+     bool _tagInFlash;
 
+     /*
+     message: in flash if flash is set
+     */
+     void print(LogLevel level, const char* message, bool flash);
+     void printTag();
+
+     void printSet(unsigned char reg, unsigned char field, long value, LogFormat format, bool success);
+
+     // reg and subreg are in flash if flash is set
+     void printSetStart(const char* reg, const char* subreg, bool success, bool flash);
+
+     void printSetEnd(bool success);
+     void printRegister(unsigned long time, unsigned char reg, unsigned char source,
+                        unsigned int oldValue, unsigned int newValue);
 
+     /*
+     queues a whole record, or drops it if it doesn't fit
+     data: in flash if flash is set
+     */
+     bool push(const unsigned char* header, unsigned char headerLength, const char* data, unsigned char dataLength, bool flash = false);
+
+     /*
+     fills the start of a record, returns its length (7)
+     */
+     unsigned char recordStart(unsigned char* record, unsigned char event);
 
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -17,11 +17,21 @@
 */
 #include <SPI.h>
 #include <Arduino.h>
+#include <EEPROM.h>
 #include "drv.h"
 #include "Logger.h"
 
-// initialize logging object
-Logger logger("DRV8704", "info");
+// initialize logging object, strings passed to it stay in flash
+const char drvTag[] PROGMEM = "DRV8704";
+Logger logger((const __FlashStringHelper*)drvTag, LOG_INFO);
+
+// names for the logger's id based messages
+const LogDictionary drvDictionary = {
+  drvFields::registerNames,
+  drvFields::fieldNames,
+  drvFields::valueNames,
+  drvFields::sourceNames
+};
 
 // register addresses (for internal functions)
 const int CTRL = 0x0;
@@ -32,7 +42,62 @@ const int DECAY = 0x4;
 const int DRIVE = 0x6;
 const int STATUS = 0x7;
 
-bool faults[] = {0, 0, 0, 0, 0, 0};
+// devices with a fault monitor, for the interrupt handlers
+const int MAX_FAULT_MONITORS = 2;
+drv* faultMonitors[MAX_FAULT_MONITORS] = {NULL, NULL};
+
+void faultInterrupt0() {
+  faultMonitors[0]->onFaultInterrupt();
+}
+
+void faultInterrupt1() {
+  faultMonitors[1]->onFaultInterrupt();
+}
+
+void (*const faultInterrupts[MAX_FAULT_MONITORS])() = {faultInterrupt0, faultInterrupt1};
+
+#if defined(__AVR__) && !defined(DRV_NO_PCINT)
+/*
+pin change interrupts for nFAULT pins without an external interrupt
+(pin 7 on an Uno). Define DRV_NO_PCINT if another library owns the
+PCINT vectors, serviceFaults then polls the pin.
+*/
+#define DRV_USE_PCINT
+
+void pollFaultPins() {
+  for (int i = 0; i < MAX_FAULT_MONITORS; i++) {
+    if (faultMonitors[i] != NULL) {
+      faultMonitors[i]->onFaultInterrupt();
+    }
+  }
+}
+
+#ifdef PCINT0_vect
+ISR(PCINT0_vect) { pollFaultPins(); }
+#endif
+#ifdef PCINT1_vect
+ISR(PCINT1_vect) { pollFaultPins(); }
+#endif
+#ifdef PCINT2_vect
+ISR(PCINT2_vect) { pollFaultPins(); }
+#endif
+#endif
+
+// bits of each register that hold settings (reserved bits read back as 0)
+const unsigned int regMasks[8] PROGMEM = {
+    0xF01, // CTRL    DTIME, ISGAIN, ENBL
+    0x0FF, // TORQUE  TORQUE
+    0x1FF, // OFF     PWMMODE, TOFF
+    0x0FF, // BLANK   TBLANK
+    0x7FF, // DECAY   DECMOD, TDECAY
+    0x000, // RESERVED register (unused)
+    0xFFF, // DRIVE   IDRIVEP, IDRIVEN, TDRIVEP, TDRIVEN, OCPDEG, OCPTH
+    0x03F, // STATUS  UVLO, BPDF, APDF, BOCP, AOCP, OTS
+};
+
+unsigned int regMask(unsigned int address) {
+  return pgm_read_word(&regMasks[address]);
+}
 
 // constructor
 drv::drv(int out, int in, int clk, int select) {
@@ -43,219 +108,498 @@ drv::drv(int out, int in, int clk, int select) {
   _SCLK = clk;
   _SCS = select;
 
-  // updated with currentRegisterValues
-  unsigned int currentRegisterValues[8];
-
-  unsigned int initRegs[] = {
-      0x301, // B001100000001  CTRL
-      0x0FF, // B000011111111  TORQUE
-      0x130, // B000100110000  OFF
-      0x080, // B000010000000  BLANK
-      0x010, // B000000010000  DECAY
-      0x000, // B000000000000  RESERVED register (unused)
-      0xFA5, // B111110100101  DRIVE
-      0x000, // B000000000000  STATUS
-  };    
-
-  bool faults[] = {0, 0, 0, 0, 0, 0};
-    
-  
+  logger.setDictionary(&drvDictionary);
+
+  _clock = 140000;
+  _settings = SPISettings(_clock, MSBFIRST, SPI_MODE0);
+
+  for (int i = 0; i < 8; i++) {
+    initRegs[i] = drvProfileImage(DRV_DEFAULT_PROFILE, i);
+    // updated from the chip by syncRegisters
+    currentRegisterValues[i] = initRegs[i];
+  }
+
+  for (int i = 0; i < 6; i++) {
+    faults[i] = false;
+    faultCounts[i] = 0;
+    faultFirstSeen[i] = 0;
+    faultLastSeen[i] = 0;
+  }
+  activeFaults = 0;
+  _faultPending = false;
+  _faultInterrupt = false;
+  _faultReadAt = 0;
+  _faultCallback = NULL;
+  _faultAutoClear = 0;
+
+  // shadow is seeded from the chip on first use, setters verify every write
+  _shadowValid = false;
+  _verifyPolicy = VERIFY_EVERY_N;
+  _verifyEvery = 1;
+  _writesSinceVerify = 0;
+  _verifyPin = -1;
+  _faultPin = -1;
+
+  _batchLength = 0;
+  resetTiming();
+  frameCount = 0;
+  verifyErrors = 0;
+
+  for (int i = 0; i < 8; i++) {
+    regErrors[i] = 0;
+  }
+  busRetries = 0;
+  busFailures = 0;
+  _retries = 2;
+  _backoff = 20;
+  _readbackEvery = 0;
+  _writesSinceReadback = 0;
+  _failLimit = 3;
+  _failRun = 0;
+  _busFailed = false;
+  _busProbe = false;
+  _busFailureCallback = NULL;
+  _tripped = false;
+
+  _streaming = false;
+  _streamFrame = 0;
+  _streamVerifyEvery = 0;
+  _streamVerifiedAt = 0;
+  streamPushes = 0;
+  streamErrors = 0;
+
+  _journalNext = 0;
+  _journalLength = 0;
+  _journalOn = true;
+  _journalSource = drvFields::SOURCE_API;
+  _dumpSlot = 0;
+  _dumpLeft = 0;
+
+  _sleepPin = -1;
+  _power = POWER_AWAKE;
+  _wakeStarted = 0;
+
+#if defined(__AVR__)
+  _scsPort = portOutputRegister(digitalPinToPort(_SCS));
+  _scsMask = digitalPinToBitMask(_SCS);
+#endif
 }
 
 /*
 PRIVATE INTERNALS
 */
 
-// functions to check registers
-bool checkValsANDBitMask (unsigned int val1, unsigned int val2, unsigned int mask) {
-  /*
-  compares two values after ANDing them with bitmask mask.
-  */
-    if(val1 & mask == val2 & mask) {
-    return true;
-  } else {
-    return false;
-  }
+/*
+PUBLIC FUNCTIONS
+*/
+void drv::open() {
+  digitalWrite(_SCS, HIGH);
+  SPI.beginTransaction(_settings);  
 }
 
-bool checkCTRL(unsigned int actual, unsigned int desired) {
-  /*
-  Check the CTRL register against a desired value
+SPISettings drv::settings() {
+  return _settings;
+}
 
-  actual : the value of the the register (12 bits)
-  desired : the desired value of the register (12 bits, reserved sections should be 0)
-  returns : true if actual matches desired 
-  */
+unsigned long drv::clock() {
+  return _clock;
+}
 
-  // check DTIME and ISGAIN                         and ENBL 
-  if (checkValsANDBitMask(actual, desired, 0xF00) &&  checkValsANDBitMask(actual, desired, 0x1)) {
-    return true;
-  } else {
-    logger.loge("CRTL register not ok");
-    return false;
-  }
+void drv::setClock(unsigned long hz) {
+  _clock = hz;
+  _settings = SPISettings(_clock, MSBFIRST, SPI_MODE0);
 }
 
-bool checkTORQUE(unsigned int actual, unsigned int desired) {
+// the DRV8704 takes SCLK up to 4 MHz
+const unsigned long drv::clockSteps[drv::CLOCK_STEPS] PROGMEM = {
+  140000, 250000, 500000, 1000000, 2000000, 4000000
+};
+
+unsigned long drv::autoTuneClock(ClockResult* report) {
   /*
-  Check the TORQUE register against a desired value
+  Step the clock up until write/readback patterns fail, then back off.
 
-  actual : the value of the the register (12 bits)
-  desired : the desired value of the register (12 bits, reserved sections should be 0s)
-  returns : true if actual matches desired 
+  report : one entry per rate, entries for rates not tried have hz 0
+  returns : the clock in use afterwards, 0 if no rate was clean or the
+  restore didn't read back
   */
-  
-  // check TORQUE 
-  if (checkValsANDBitMask(actual, desired, 0xFF)) {
-    return true;
-  } else {
-    logger.loge("TORQUE register not ok");
-    return false;
-  }
-}
+  JournalScope scope(*this, drvFields::SOURCE_CLOCK);
+  const unsigned int patterns[] = {0x00, 0xFF, 0x55, 0xAA, 0x0F, 0xF0, 0x33, 0xCC};
+  const int patternCount = sizeof(patterns) / sizeof(patterns[0]);
 
-bool checkOFF(unsigned int actual, unsigned int desired) {
-  /*
-  Checks the OFF register against a desired value
+  if (get<drvFields::ENBL>()) {
+    logger.loge(F("clock tune: disable the bridge first"));
+    return _clock;
+  }
 
-  actual : the value of the the register (12 bits)
-  desired : the desired value of the register (12 bits, reserved sections should be 0s)
-  returns : true if actual matches desired 
-  */
- 
- // checks TOFF                                    and PWMMODE (should always be 1)
-  if (checkValsANDBitMask(actual, desired, 0xFF) && checkValsANDBitMask(actual, 0x100, 0x100)) {
-    return true;
-  } else {
-    logger.loge("OFF register not ok");
-    return false;
+  unsigned long original = _clock;
+  unsigned int saved[8];
+  for (int i = 0; i < 8; i++) {
+    saved[i] = cached(i);
+  }
+  unsigned int torque = saved[TORQUE];
+  unsigned int blank = saved[BLANK];
+  int fastestClean = -1;
+
+  // the patterns find the errors, the reliability layer mustn't retry them away
+  _busProbe = true;
+
+  for (int step = 0; step < CLOCK_STEPS; step++) {
+    unsigned int errors = 0;
+    unsigned long frames = timing.singleFrames;
+    unsigned long start = micros();
+
+    unsigned long hz = pgm_read_dword(&clockSteps[step]);
+
+    setClock(hz);
+    for (int i = 0; i < patternCount; i++) {
+      unsigned int value = patterns[i];
+      write(TORQUE, (torque & ~0xFF) | value);
+      write(BLANK, (blank & ~0xFF) | (value ^ 0xFF));
+      errors += (read(TORQUE) & 0xFF) != value;
+      errors += (read(BLANK) & 0xFF) != (value ^ 0xFF);
+    }
+
+    if (report) {
+      report[step].hz = hz;
+      report[step].errors = errors;
+      report[step].frameMicros = (micros() - start) / (timing.singleFrames - frames);
+    }
+
+    if (errors) {
+      break;
+    }
+    fastestClean = step;
   }
-}
 
-bool checkBLANK(unsigned int actual, unsigned int desired) {
-  /*
-  Checks the BLANK register against a desired value
+  if (report) {
+    for (int step = fastestClean + 2; step < CLOCK_STEPS; step++) {
+      report[step].hz = 0;
+    }
+  }
 
-  actual : the value of the the register (12 bits)
-  desired : the desired value of the register (12 bits, reserved sections should be 0s)
-  returns : true if actual matches desired 
-  */
-  if (checkValsANDBitMask(actual, desired, 0xFF)) {
-    return true;
+  // with no clean rate fall back to the slowest clock known, not a failing one
+  unsigned long slowest = pgm_read_dword(&clockSteps[0]);
+  if (fastestClean < 0) {
+    setClock(original < slowest ? original : slowest);
   } else {
-    logger.loge("BLANK register not ok");
-    return false;
+    setClock(pgm_read_dword(&clockSteps[fastestClean > 0 ? fastestClean - 1 : 0]));
   }
-}
 
-bool checkDECAY(unsigned int actual, unsigned int desired) {
-  /*
-  Checks the DECAY register against a desired value
+  _busProbe = false;
 
-  actual : the value of the the register (12 bits)
-  desired : the desired value of the register (12 bits, reserved sections should be 0s)
-  returns : true if actual matches desired 
+  /*
+  Put back what the patterns overwrote and check every writable register
+  against the saved values: a corrupted address field can have landed a
+  pattern anywhere, CTRL (ENBL) and DRIVE included. CTRL goes first, and
+  a register that differs is written again once. verify() would resync
+  the shadow to whatever the chip holds, so a corrupt restore would pass
+  as correct; checkedRead leaves the shadow at the intended values.
   */
+  const int restoreOrder[] = {CTRL, TORQUE, OFF, BLANK, DECAY, DRIVE};
+  bool restored = true;
+  for (int i = 0; i < 6; i++) {
+    unsigned int address = restoreOrder[i];
+    bool probed = address == (unsigned int)TORQUE || address == (unsigned int)BLANK;
+    bool same = false;
+    for (int attempt = 0; attempt < 2 && !same; attempt++) {
+      if (probed || attempt > 0) {
+        write(address, saved[address]);
+      }
+      bool sane;
+      unsigned int back = checkedRead(address, false, sane);
+      same = sane && ((back ^ saved[address]) & regMask(address)) == 0;
+    }
+    restored = restored && same;
+  }
 
-  // check DECAY                                           and DECMOD
-  if (checkValsANDBitMask(actual, desired, 0xFF) && checkValsANDBitMask(actual, desired, 0x700)) {
-    return true;
-  } else {
-    logger.loge("DECAY register not ok");
-    return false;
+  if (fastestClean < 0) {
+    logger.loge(F("clock tune: no clean rate"));
+  }
+  if (!restored) {
+    verifyErrors++;
+    logger.loge(F("clock tune: registers not restored"));
   }
+  if (fastestClean < 0 || !restored) {
+    return 0;
+  }
+  logger.logi(F("clock tuned"));
+  return _clock;
 }
 
-bool checkDRIVE(unsigned int actual, unsigned int desired) {
- /*
-  Checks the DECAY register against a desired value
+void drv::close() {
+  SPI.endTransaction();
+  digitalWrite(_SCS, LOW);
+}
 
-  actual : the value of the the register (12 bits)
-  desired : the desired value of the register (12 bits)
-  returns : true if actual matches desired 
-  */
-  // no bitmask needed
-  if (actual == desired) {
-    return true;
+void drv::select(bool selected) {
+#if defined(__AVR__)
+  if (selected) {
+    *_scsPort |= _scsMask;
   } else {
-    logger.loge("DRIVE register not ok");
-    return false;
-  } 
+    *_scsPort &= ~_scsMask;
+  }
+#else
+  digitalWrite(_SCS, selected ? HIGH : LOW);
+#endif
 }
 
-bool checkSTATUS(unsigned int actual, unsigned int desired) {
+unsigned int drv::transfer(unsigned int packet) {
   /*
-  Checks the STATUS register against a desired value
-
-  actual : the value of the the register (12 bits)
-  desired : the desired value of the register (12 bits)
-  returns : true if actual matches desired 
+  SCS is active high and has to drop between frames. Interrupts are off
+  for the frame, so an isr frame can't split it, and the trip latch is
+  checked inside that window so no CTRL write can slip past an isrTrip.
   */
-  return checkValsANDBitMask(actual, desired, 0x3F);
+  InterruptLock lock;
+  packet = gate(packet);
+  select(true);
+  unsigned int value = SPI.transfer16(packet);
+  select(false);
+  frameCount++;
+  return value;
 }
 
-bool checkALL(int actualRegs[], int desiredRegs[]) {
-  return (checkCTRL(actualRegs[CTRL], desiredRegs[CTRL]) 
-          && checkTORQUE(actualRegs[TORQUE], desiredRegs[TORQUE])
-          && checkOFF(actualRegs[OFF], desiredRegs[OFF])
-          && checkBLANK(actualRegs[BLANK], desiredRegs[BLANK])
-          && checkDECAY(actualRegs[DECAY], desiredRegs[DECAY])
-          && checkDRIVE(actualRegs[DRIVE], desiredRegs[DECAY])
-          && checkSTATUS(actualRegs[STATUS], desiredRegs[STATUS]));
-          
+unsigned int drv::gate(unsigned int packet) {
+  if (_tripped && (packet & 0xF000) == ((unsigned int)CTRL << 12)) {
+    packet &= ~drvFields::ENBL::mask;
+  }
+  return packet;
 }
 
-/*
-PUBLIC FUNCTIONS
-*/
-void drv::open() {
-  digitalWrite(_SCS, HIGH);
-  SPI.beginTransaction(SPISettings(140000, MSBFIRST, SPI_MODE0));  
+void drv::store(unsigned int address, unsigned int value) {
+  InterruptLock lock;
+  if (_tripped && address == (unsigned int)CTRL) {
+    value &= ~drvFields::ENBL::mask;
+  }
+  currentRegisterValues[address] = value & 0xFFF;
 }
 
-void drv::close() {
+unsigned int drv::singleFrame(unsigned int packet) {
+  unsigned long start = micros();
+  SPI.beginTransaction(_settings);
+  unsigned int value = transfer(packet);
   SPI.endTransaction();
-  digitalWrite(_SCS, LOW);
+
+  timing.singleMicros += micros() - start;
+  timing.singleFrames++;
+  return value;
 }
 
 unsigned int drv::read(unsigned int address) {
     /*
      Read from a register over SPI using Arduino SPI library.
+     A frame that fails frameSane is read again, up to _retries times with
+     a doubling backoff, and the shadow only takes a sane value.
 
      Args: address -> int 0xX where X <= 7
-     Return: integer representing register value. 
+     Return: integer representing register value (the last frame received
+     if every attempt failed)
 
      Example:  data = spiReadReg(0x6);
     */ 
-    unsigned int value;
-    address = address << 12; // allocate zeros for data
-    address |= 0x8000; // set MSB to read (1)
-    open();
-    value = SPI.transfer16(address); // transfer read request, recieve data
-    close();
+    unsigned int reg = address & 0x7;
+    bool sane;
+    unsigned int value = checkedRead(reg, false, sane);
+
+    if (sane) {
+      journal(reg | JOURNAL_READ, currentRegisterValues[reg], value & 0xFFF, _journalSource);
+      store(reg, value); // keep shadow in step with the chip
+    }
     
     return value;
 }
 
+unsigned int drv::checkedRead(unsigned int reg, bool held, bool& sane) {
+  unsigned int value = 0;
+  unsigned int packet = (reg << 12) | 0x8000; // set MSB to read (1), zeros for data
+  unsigned char attempts = _busProbe ? 1 : _retries + 1;
+  sane = false;
+
+  for (unsigned char attempt = 0; attempt < attempts && !sane; attempt++) {
+    if (attempt > 0) {
+      busRetries++;
+      delayMicroseconds(_backoff << (attempt - 1));
+    }
+    value = held ? transfer(packet) : singleFrame(packet); // transfer read request, recieve data
+    sane = _busProbe || frameSane(reg, value);
+    if (!sane) {
+      regErrors[reg]++;
+    }
+  }
+  if (!_busProbe) {
+    busResult(sane);
+  }
+  return value;
+}
 
-void drv::write(unsigned int address, unsigned int value) {
+
+bool drv::write(unsigned int address, unsigned int value) {
  /*
   Write to register over SPI using Arduino SPI library.
+  Every _readbackEvery-th write is read back and sent again, up to
+  _retries times with a doubling backoff, until the chip agrees.
 
   address : int 0xX where X <= 0x7, 
   value : int to be written (as binary) to register. (12 bits)
-  returns : true if write successful, false otherwise
+  returns : false if a readback kept disagreeing, true otherwise
   Example:  spiWriteReg(0x6, 0x0FF0);
 
   */
-  unsigned int packet=0;
+  unsigned int reg = address & 0x7;
+  unsigned int packet = (reg << 12) | (value & 0xFFF); // MSB clear to write (0)
+  bool check = !_busProbe && _readbackEvery > 0 && reg != (unsigned int)STATUS
+               && ++_writesSinceReadback >= _readbackEvery;
+  unsigned char attempts = check ? _retries + 1 : 1;
+  bool ok = !check;
+
+  for (unsigned char attempt = 0; attempt < attempts && !ok; attempt++) {
+    if (attempt > 0) {
+      busRetries++;
+      delayMicroseconds(_backoff << (attempt - 1));
+    }
+    singleFrame(packet);
+    unsigned int back = singleFrame((reg << 12) | 0x8000);
+    // while tripped the chip got CTRL without ENBL
+    ok = frameSane(reg, back) && ((back ^ gate(packet)) & regMask(reg)) == 0;
+    if (!ok) {
+      regErrors[reg]++;
+    }
+  }
+  if (check) {
+    _writesSinceReadback = 0;
+    busResult(ok);
+  } else {
+    singleFrame(packet);
+  }
+
+  journal(reg, currentRegisterValues[reg], value & 0xFFF, _journalSource);
+  store(reg, value); // write-through to the shadow
+  return ok;
+}
 
-  address = address << 12; // build packet skelleton
-  address &= ~0x8000; // set MSB to write (0)
-  packet = address | value;
-  open();  // open comms
-  SPI.transfer16(packet);
-  close(); // close
+bool drv::frameSane(unsigned int address, unsigned int frame) {
+  // reserved bits read back as 0, all ones is MISO stuck high
+  return frame != 0xFFFF && (frame & 0xFFF & ~regMask(address)) == 0;
+}
+
+void drv::busResult(bool ok) {
+  if (ok) {
+    _failRun = 0;
+    return;
+  }
+  busFailures++;
+  if (_failRun < 0xFF) {
+    _failRun++;
+  }
+  if (_failRun >= _failLimit && !_busFailed) {
+    _busFailed = true; // set first, the callback may use the bus
+    logger.loge(F("SPI: bus failed"));
+    if (_busFailureCallback != NULL) {
+      _busFailureCallback(*this);
+    }
+  }
+}
+
+void drv::setReliability(unsigned char retries, unsigned int backoffMicros,
+                         unsigned int readbackEvery, unsigned char failLimit) {
+  _retries = retries;
+  _backoff = backoffMicros;
+  _readbackEvery = readbackEvery;
+  _writesSinceReadback = 0;
+  _failLimit = failLimit > 0 ? failLimit : 1;
+}
+
+void drv::onBusFailure(BusFailureCallback callback) {
+  _busFailureCallback = callback;
+}
+
+bool drv::busHealthy() {
+  return !_busFailed;
+}
+
+void drv::clearBusFailure() {
+  _busFailed = false;
+  _failRun = 0;
+}
+
+// *** ISR SAFE ***
+
+unsigned int drv::isrFrame(unsigned int packet) {
+  /*
+  The frame may land between two frames of someone else's transaction,
+  so the SPI registers are put back as they were rather than ending one.
+  */
+  InterruptLock lock;
+#if defined(__AVR__)
+  uint8_t spcr = SPCR;
+  uint8_t spsr = SPSR;
+  SPI.beginTransaction(_settings);
+  unsigned int value = transfer(packet);
+  SPCR = spcr;
+  SPSR = spsr;
+#else
+  SPI.beginTransaction(_settings);
+  unsigned int value = transfer(packet);
+  SPI.endTransaction();
+#endif
+  return value;
+}
+
+void drv::isrTorque(unsigned char value) {
+  // TORQUE has no other bits
+  InterruptLock lock;
+  isrFrame((TORQUE << 12) | value);
+  currentRegisterValues[TORQUE] = value;
+}
+
+bool drv::isrBridge(bool on) {
+  /*
+  Shadow read, frame and shadow update are one masked step, so an ISR
+  can't change CTRL in between when this is called from loop().
+  */
+  InterruptLock lock;
+  if (on && _tripped) {
+    return false;
+  }
+  unsigned int ctrl = currentRegisterValues[CTRL] & ~drvFields::ENBL::mask;
+  if (on) {
+    ctrl |= drvFields::ENBL::mask;
+  }
+  isrFrame((CTRL << 12) | ctrl);
+  currentRegisterValues[CTRL] = ctrl;
+  return true;
+}
+
+void drv::isrTrip() {
+  // latched first, transfer and store clear ENBL from then on
+  InterruptLock lock;
+  _tripped = true;
+  isrFrame((CTRL << 12) | currentRegisterValues[CTRL]);
+  store(CTRL, currentRegisterValues[CTRL]);
+}
+
+int drv::isrStatus() {
+  InterruptLock lock;
+  unsigned int frame = isrFrame((STATUS << 12) | 0x8000);
+  if (!frameSane(STATUS, frame)) {
+    regErrors[STATUS]++;
+    return -1;
+  }
+  currentRegisterValues[STATUS] = frame & 0xFFF;
+  if ((frame & 0x3F) != 0) {
+    _faultPending = true; // serviceFaults reports it
+  }
+  return frame & 0x3F;
+}
+
+void drv::clearTrip() {
+  // drvAsync writes the shadow directly, the read settles CTRL either way
+  _tripped = false;
+  read(CTRL);
+}
+
+bool drv::tripped() {
+  return _tripped;
 }
 
 void drv::getCurrentRegisters (){
@@ -263,552 +607,973 @@ void drv::getCurrentRegisters (){
   Populate currentRegisterValues variable with the integers returned from
   spiReadReg at each memory register 0-7.
   */
+  syncRegisters();
+}
+
+void drv::syncRegisters() {
+  /*
+  Seed the shadow registers from the chip in a single batch. runBatch()
+  stores each value in currentRegisterValues.
+  */
+  JournalScope scope(*this, drvFields::SOURCE_SYNC);
+  beginBatch();
+  for (int i = 0; i < 8; i++) {
+    queueRead(i);
+  }
+  runBatch();
+  _shadowValid = true;
+  _writesSinceVerify = 0;
+}
+
+unsigned int drv::cached(unsigned int address) {
+  /*
+  Shadowed value of a register, the bus is only touched the first time
+  a shadow value is needed.
+  */
+  if (!_shadowValid) {
+    syncRegisters();
+  }
+  return currentRegisterValues[address];
+}
+
+bool drv::verify(unsigned int address) {
+  /*
+  Read back a register and compare its significant bits with the shadow.
+  On mismatch read() has already replaced the shadow value with the chip's.
+  */
+  JournalScope scope(*this, drvFields::SOURCE_VERIFY);
+  unsigned int expected = currentRegisterValues[address];
+  unsigned int actual = read(address) & 0xFFF;
+
+  _writesSinceVerify = 0;
+
+  if (((actual ^ expected) & regMask(address)) == 0) {
+    return true;
+  }
+  verifyErrors++;
+  logger.loge(F("shadow register mismatch, resynced"));
+  return false;
+}
+
+void drv::setVerifyPolicy(VerifyPolicy policy, unsigned int n, int faultPin) {
+  _verifyPolicy = policy;
+  _verifyEvery = n > 0 ? n : 1;
+  _verifyPin = faultPin;
+  _writesSinceVerify = 0;
+}
+
+bool drv::commit(unsigned int address, unsigned int value) {
+  /*
+  Write a setter's value and read it back if the verify policy says so.
+
+  returns : false only if a read back disagreed with the written value
+  */
+  bool ok = write(address, value);
+  _writesSinceVerify++;
+
+  if (verifyDue()) {
+    return verify(address) && ok;
+  }
+  return ok;
+}
+
+bool drv::verifyDue() {
+  if (_verifyPolicy == VERIFY_EVERY_N) {
+    return _writesSinceVerify >= _verifyEvery;
+  }
+  return _verifyPolicy == VERIFY_ON_FAULT && _verifyPin >= 0 && digitalRead(_verifyPin) == LOW;
+}
+
+void drv::beginBatch() {
+  _batchLength = 0;
+}
 
-  //populate currentRegisterValues array 
-  for (int i = 0; i < 7; i++){
-      currentRegisterValues[i] = read(i);
-  }    
+int drv::queueRead(unsigned int address) {
+  if (_batchLength >= BATCH_SIZE) {
+    logger.loge(F("batch full"));
+    return -1;
+  }
+  _batchFrames[_batchLength] = (address << 12) | 0x8000; // MSB set to read
+  return _batchLength++;
 }
 
-void drv::regDiagnostic(int desiredRegs[]) {
+bool drv::queueWrite(unsigned int address, unsigned int value) {
+  if (_batchLength >= BATCH_SIZE) {
+    logger.loge(F("batch full"));
+    return false;
+  }
+  _batchFrames[_batchLength++] = (address << 12) | (value & 0xFFF); // MSB clear to write
+  return true;
+}
+
+int drv::runBatch() {
   /*
-  If after drv powerup, registers are not default valued, _LED  goes high
+  Transfer every queued frame inside one SPI transaction. Read frames are
+  replaced with the 12 bit value returned by the chip.
 
-  desiredRegs : can be any array of 7 12 bit numbers to check correct config of the registers
+  returns : number of frames transferred
   */
+  int frames = _batchLength;
+  unsigned long start = micros();
+
+  unsigned int retry = 0; // bit i: read frame i failed its check
+
+  SPI.beginTransaction(_settings);
+  for (int i = 0; i < frames; i++) {
+    unsigned int packet = _batchFrames[i];
+    unsigned int reg = (packet >> 12) & 0x7;
+    unsigned int frame = transfer(packet);
+    unsigned int value = frame & 0xFFF;
+
+    if ((packet & 0x8000) && !_busProbe && !frameSane(reg, frame)) {
+      regErrors[reg]++;
+      retry |= 1u << i;
+    } else if (packet & 0x8000) {
+      _batchFrames[i] = value;
+      journal(reg | JOURNAL_READ, currentRegisterValues[reg], value, _journalSource);
+      store(reg, value);
+    } else {
+      journal(reg, currentRegisterValues[reg], packet & 0xFFF, _journalSource);
+      store(reg, packet);
+    }
+  }
+  SPI.endTransaction();
+
+  timing.batchMicros += micros() - start;
+  timing.batchFrames += frames;
+  _batchLength = 0;
+
+  // bad read frames go again through read(), after the rest of the batch
+  for (int i = 0; i < frames; i++) {
+    if (retry & (1u << i)) {
+      busRetries++;
+      _batchFrames[i] = read((_batchFrames[i] >> 12) & 0x7) & 0xFFF;
+    }
+  }
 
-  getCurrentRegisters();
+  return frames;
+}
 
-  if (checkALL(currentRegisterValues, desiredRegs)) {
-    logger.logi("initialization correct");
+unsigned int drv::batchResult(int index) {
+  if (index < 0 || index >= BATCH_SIZE) {
+    return 0;
+  }
+  return _batchFrames[index];
+}
+
+long drv::batchSavedMicros() {
+  /*
+  Cost the batched frames at the average per-call frame time.
+  */
+  if (timing.singleFrames == 0) {
+    return 0;
+  }
+  unsigned long perFrame = timing.singleMicros / timing.singleFrames;
+  return (long)(perFrame * timing.batchFrames) - (long)timing.batchMicros;
+}
+
+void drv::resetTiming() {
+  timing.singleMicros = 0;
+  timing.singleFrames = 0;
+  timing.batchMicros = 0;
+  timing.batchFrames = 0;
+}
+
+int drv::writeImages(const unsigned int images[], const unsigned int reference[]) {
+  /*
+  Queue the registers whose image differs from reference, plus their
+  readbacks if the verify policy calls for them, and run one batch.
+
+  images : 12 bit values for CTRL to DRIVE, indexed by address
+  reference : what the chip is known to hold, indexed by address
+  returns : registers written, -1 if a readback disagreed
+  */
+
+  // the bridge only switches on once everything else is configured
+  const int enabling[] = {TORQUE, OFF, BLANK, DECAY, DRIVE, CTRL};
+  const int disabling[] = {CTRL, TORQUE, OFF, BLANK, DECAY, DRIVE};
+  const int* order = (images[CTRL] & drvFields::ENBL::mask) ? enabling : disabling;
+
+  unsigned int addresses[6];
+  int writes = 0;
+
+  beginBatch();
+  for (int i = 0; i < 6; i++) {
+    unsigned int address = order[i];
+    if ((reference[address] ^ images[address]) & regMask(address)) {
+      addresses[writes++] = address;
+      queueWrite(address, images[address]);
+    }
+  }
+
+  if (writes == 0) {
+    return 0;
+  }
+
+  _writesSinceVerify += writes;
+  bool check = verifyDue();
+  int first = -1;
+  if (check) {
+    for (int i = 0; i < writes; i++) {
+      int index = queueRead(addresses[i]);
+      if (first < 0) {
+        first = index;
+      }
+    }
+    _writesSinceVerify = 0;
+  }
+  runBatch();
+
+  if (check) {
+    for (int i = 0; i < writes; i++) {
+      unsigned int sent = gate((addresses[i] << 12) | images[addresses[i]]);
+      if ((batchResult(first + i) ^ sent) & regMask(addresses[i])) {
+        verifyErrors++;
+        return -1;
+      }
+    }
+  }
+  return writes;
+}
+
+bool drv::applyProfile(const DrvProfile& profile) {
+  /*
+  Diff the profile's register images against the shadow and send only
+  the registers that differ, plus their readbacks, in one batch.
+
+  profile : settings to apply (see drvProfile.h)
+  returns : false if the profile is invalid or a readback disagreed
+  */
+  JournalScope scope(*this, drvFields::SOURCE_PROFILE);
+  if (!drvProfileValid(profile)) {
+    logger.loge(F("profile: invalid setting"));
+    return false;
+  }
+
+  unsigned int images[8];
+  for (int i = 0; i < 8; i++) {
+    images[i] = drvProfileImage(profile, i);
+  }
+
+  cached(CTRL); // seeds the shadow if needed
+  int writes = writeImages(images, currentRegisterValues);
+
+  if (writes < 0) {
+    logger.loge(F("profile: readback mismatch"));
+    return false;
+  }
+  if (writes == 0) {
+    logger.logi(F("profile: already applied"));
   } else {
-    logger.loge("initialization incorrect");
+    logger.logi(F("profile applied"));
+  }
+  return true;
+}
+
+bool drv::applyProfile_P(const DrvProfile* profile) {
+  DrvProfile copy;
+  memcpy_P(&copy, profile, sizeof(copy));
+  return applyProfile(copy);
+}
+
+// checksum stored after a profile in EEPROM, erased EEPROM (0xFF) never matches
+unsigned char profileChecksum(const DrvProfile& profile) {
+  const unsigned char* bytes = (const unsigned char*)&profile;
+  unsigned char sum = 0x5A;
+  for (unsigned int i = 0; i < sizeof(profile); i++) {
+    sum += bytes[i];
+  }
+  return sum;
+}
+
+bool drv::saveProfile(const DrvProfile& profile, int address) {
+  if (!drvProfileValid(profile)) {
+    logger.loge(F("profile: invalid setting"));
+    return false;
+  }
+  // put() only rewrites bytes that changed
+  EEPROM.put(address, profile);
+  EEPROM.update(address + sizeof(profile), profileChecksum(profile));
+  return true;
+}
+
+bool drv::loadProfile(DrvProfile& profile, int address) {
+  EEPROM.get(address, profile);
+  if (EEPROM.read(address + sizeof(profile)) != profileChecksum(profile) || !drvProfileValid(profile)) {
+    logger.loge(F("profile: none saved"));
+    return false;
   }
+  return true;
+}
+
+unsigned int drv::regDiagnostic(const unsigned int desiredRegs[]) {
+  /*
+  Snapshot the registers in one batch and XOR them with desiredRegs under
+  regMasks. Only registers that differ are broken down into fields, and
+  field names are only looked up when errors are logged.
+
+  desiredRegs : 8 12 bit register values, e.g. initRegs or a profile's images
+  returns : mismatched fields, bit n set for FieldId n, DIAG_STATUS for faults
+  */
+  JournalScope scope(*this, drvFields::SOURCE_DIAG);
+  unsigned int diff[8];
+  unsigned int any = 0;
+
+  beginBatch();
+  for (int i = 0; i < 8; i++) {
+    if (regMask(i)) {
+      queueRead(i);
+    }
+  }
+  runBatch();
+  _shadowValid = true;
+
+  for (int i = 0; i < 8; i++) {
+    diff[i] = (currentRegisterValues[i] ^ desiredRegs[i]) & regMask(i);
+    any |= diff[i];
+  }
+
+  if (!any) {
+    logger.logi(F("initialization correct"));
+    return 0;
+  }
+
+  unsigned int mismatched = diff[STATUS] ? DIAG_STATUS : 0;
+  for (int f = 0; f < drvFields::FIELD_COUNT; f++) {
+    if (diff[drvFields::fieldReg(f)] & drvFields::fieldMask(f)) {
+      mismatched |= 1u << f;
+    }
+  }
+
+  if (logger.enabled(LOG_ERROR)) {
+    char message[LOG_MESSAGE_MAX];
+    for (int f = 0; f <= drvFields::FIELD_COUNT; f++) {
+      if (mismatched & (1u << f)) {
+        const char* const* names = f < drvFields::FIELD_COUNT ? &drvFields::fieldNames[f] : &drvFields::registerNames[STATUS];
+        strcpy_P(message, (const char*)pgm_read_ptr(names));
+        strcat_P(message, PSTR(" not ok"));
+        logger.loge(message);
+      }
+    }
+    logger.loge(F("initialization incorrect"));
+  }
+  return mismatched;
 }
 
 void drv::setLogging(char* level) {
+  setLogging(Logger::parseLevel(level));
+}
+
+void drv::setLogging(LogLevel level) {
   // sets logging level for the drv logger
   logger.setLevel(level);
-  Serial.println("REV - DRV8704 driver loaded");
-  Serial.print("DRV8704 - Log level set: ");
-  Serial.println(level);
+  Serial.println(F("REV - DRV8704 driver loaded"));
+  Serial.print(F("DRV8704 - Log level set: "));
+  Serial.println(Logger::levelName(level));
 }
 
 // *** SETTERS ***
 
-bool drv::setHbridge(char* value) {
-  // cleat bits 16-13 from the read data (not used)
-  unsigned int current = read(CTRL) & ~0xF000;
-  unsigned int outgoing;
+/*
+sets a typed setting and logs it like the setter taking the plain value
+*/
+template <class Field, class Setting>
+bool logTyped(drv& device, Setting value, LogFormat format) {
+  int logged = Field::decode((unsigned int)value);
+  return logger.logSet(Field::reg, Field::id, logged, format, device.set<Field>(value));
+}
 
-  if (value == "off") {
-    outgoing = current & ~0x001; // clear bit 0
-  } else if (value == "on") {
-    outgoing = current | 0x001; // set bit 0
-  } else {
-    outgoing = current; // do nothing
-    logger.loge("ENBL set: invalid input");
-    return false;
+bool drv::writeField(unsigned int address, unsigned int mask, unsigned int bits) {
+  /*
+  Replace the bits under mask in the shadowed register value and commit it.
+  While the chip sleeps only the shadow changes, wake writes it.
+  */
+  unsigned int outgoing = (cached(address) & ~mask) | (bits & mask);
+  if (_power != POWER_AWAKE) {
+    store(address, outgoing);
+    return true;
   }
+  return commit(address, outgoing);
+}
 
-  write(CTRL, outgoing);
-
-  return logger.logSet("CTRL", "ENBL", value, getHbridge() == value);
+bool drv::setHbridge(Bridge value) {
+  return logTyped<drvFields::ENBL>(*this, value, LOG_NAME);
 }
 
 bool drv::setISGain(int value) {
-  unsigned int current = read(CTRL) & ~0xF000;
-  unsigned int outgoing;
-
-  if (value == 5) {
-    outgoing = current & ~0x300; // clear bits 9-8
-  } else if (value == 10) {
-    outgoing = current | 0x100; // set bit 8
-    outgoing &= ~0x200; // clear bit 9
-  } else if (value == 20) {
-    outgoing = current | 0x200; // set bit 9
-    outgoing &= ~0x100; // clear bit 8
-  } else if (value == 40) {
-    outgoing = current | 0x300; // set bits 9-8
-  } else {
-    outgoing = current; // do nothing
-    logger.loge("ISGAIN set: invalid input");
+  if (drvFields::ISGAIN::encode(value) < 0) {
+    logger.loge(F("ISGAIN set: invalid input"));
     return false;
   }
-  
-  write(CTRL, outgoing);
+  return logger.logSet(drvFields::ISGAIN::reg, drvFields::ISGAIN::id, value, LOG_INT, set<drvFields::ISGAIN>(value));
+}
 
-  return logger.logSet("CTRL", "ISGAIN", value, getISGain() == value);
+bool drv::setISGain(ISGain value) {
+  return logTyped<drvFields::ISGAIN>(*this, value, LOG_INT);
 }
 
 bool drv::setDTime(int value) {
-  unsigned int current = read(CTRL) & ~0xF000;
-  unsigned int outgoing;
-  
-  if (value == 410) {
-    outgoing = current & ~0xC00; // clear bits 11-10
-  } else if (value == 460) {
-    outgoing = current | 0x400; // set bit 10
-    outgoing &= ~0x800; // clear bit 11
-  } else if (value == 670) {
-    outgoing = current | 0x800; // set bit 11
-    outgoing &= ~0x400; // clear bit 10
-  } else if (value == 880) {
-    outgoing = current | 0xC00; // set bits 11-10
-  } else {
-    outgoing = current; // do nothing
-    logger.loge("DTIME set: invalid input");
+  if (drvFields::DTIME::encode(value) < 0) {
+    logger.loge(F("DTIME set: invalid input"));
+    return false;
   }
+  return logger.logSet(drvFields::DTIME::reg, drvFields::DTIME::id, value, LOG_INT, set<drvFields::DTIME>(value));
+}
 
-  write(CTRL, outgoing);
-
-  return logger.logSet("CTRL", "DTIME", value, getDTime() == value);
+bool drv::setDTime(DeadTime value) {
+  return logTyped<drvFields::DTIME>(*this, value, LOG_INT);
 }
 
 bool drv::setTorque(unsigned int value) {
-  unsigned int current = read(TORQUE) & ~0xF000;
-  unsigned int outgoing;
-
-  if(value <= 255 && value >= 0) {
-    outgoing = current & 0xF00; // clear bits 7-0
-    outgoing |= value; // set bits 7-0
-  } else {
-    outgoing = current; // do nothing
-    logger.loge("TORQUE set: invalid input");
+  if (drvFields::TORQUE::encode(value) < 0) {
+    logger.loge(F("TORQUE set: invalid input"));
     return false;
   }
-
-  write(TORQUE, outgoing);
-  return logger.logSet("TORQUE", "TORQUE", value, getTorque() == value);
+  return logger.logSet(drvFields::TORQUE::reg, drvFields::TORQUE::id, value, LOG_INT, set<drvFields::TORQUE>(value));
 }
 
 bool drv::setTOff(unsigned int value) {
-  unsigned int current = read(OFF) & ~0xF000;
-  unsigned int outgoing;
-
-  if(value <= 255 && value >= 0) {
-    outgoing = current & 0xF00; // clear bits 7-0
-    outgoing |= value; // set bits 7-0
-  } else {
-    outgoing = current; // do nothing
-    logger.loge("TOFF set: invalid input");
+  if (drvFields::TOFF::encode(value) < 0) {
+    logger.loge(F("TOFF set: invalid input"));
     return false;
   }
-  
-  write(OFF, outgoing);
-  return logger.logSet("OFF", "TOFF", value, getTOff() == value);
+  return logger.logSet(drvFields::TOFF::reg, drvFields::TOFF::id, value, LOG_INT, set<drvFields::TOFF>(value));
 }
 
 bool drv::setTBlank(unsigned int value) {
-  unsigned int current = read(BLANK) & ~0xF000;
-  unsigned int outgoing;
-
-  if(value <= 255 && value >= 0) {
-    outgoing = current & 0xF00; // clear bits 7-0
-    outgoing |= value; // set bits 7-0
-  } else {
-    outgoing = current; // do nothing
-    logger.loge("TBLANK set: invalid input");
+  if (drvFields::TBLANK::encode(value) < 0) {
+    logger.loge(F("TBLANK set: invalid input"));
     return false;
   }
-  
-  write(BLANK, outgoing);
-  return logger.logSet("BLANK", "TBLANK", value, getTBlank() == value);
+  return logger.logSet(drvFields::TBLANK::reg, drvFields::TBLANK::id, value, LOG_INT, set<drvFields::TBLANK>(value));
 }
 
 bool drv::setTDecay(unsigned int value) {
-  unsigned int current = read(DECAY)  & ~0xF000;
-  unsigned int outgoing;
-
-  if(value <= 255 && value >= 0) {
-    outgoing = current & 0xF00; // clear bits 7-0
-    outgoing |= value; // set bits 7-0
-  } else {
-    outgoing = current; // do nothing
-    logger.loge("TDECAY set: invalid input");
-    return false;
-  }
-  
-  write(DECAY, outgoing);
-  return logger.logSet("DECAY", "TDECAY", value, getTDecay() == value);
-}
-
-bool drv::setDecMode(char* value) {
-  unsigned int current = read(DECAY)  & ~0xF000;
-  unsigned int outgoing;
-
-  if(value == "slow") {
-    outgoing = current & ~0x700;// clear bits 10-8
-  } else if (value == "fast") {
-    outgoing = current & ~0x700; // clear bits 10-8
-    outgoing |= 0x200; // set bit 9
-  } else if (value == "mixed") {
-    outgoing = current & ~0x700; // clear bits 10-8
-    outgoing |= 0x300; // set bits 9-8
-  } else if (value == "auto") {
-    outgoing = current & ~0x700; // clear bits 10-8
-    outgoing |= 0x500; // set bits 10 and 8
-  } else {
-    outgoing = current; // do nothing
-    logger.loge("DECMOD set: invalid input");
+  if (drvFields::TDECAY::encode(value) < 0) {
+    logger.loge(F("TDECAY set: invalid input"));
     return false;
   }
+  return logger.logSet(drvFields::TDECAY::reg, drvFields::TDECAY::id, value, LOG_INT, set<drvFields::TDECAY>(value));
+}
 
-  write(DECAY, outgoing);
-  return logger.logSet("DECAY", "DECMOD", value, getDecMode() == value);
+bool drv::setDecMode(Decay value) {
+  return logTyped<drvFields::DECMOD>(*this, value, LOG_NAME);
 }
 
 bool drv::setOCPThresh(int value) {
-  unsigned int current = read(DRIVE)  & ~0xF000;
-  unsigned int outgoing;
-
-  if (value == 250) {
-    outgoing = current & ~0x003; // clear bits 1-0
-  } else if (value == 500) {
-    outgoing = current & ~0x003; // clear bits 1-0
-    outgoing |= 0x001; // set bit 0
-  } else if (value == 750) {
-    outgoing = current & ~0x003; // clear bits 1-0
-    outgoing |= 0x002; // set bit 1
-  } else if (value == 1000) {
-    outgoing = current | 0x003; // set bits 1-0
-  } else {
-    outgoing = current;
-    logger.loge("OCPTH set: invalid input");
+  if (drvFields::OCPTH::encode(value) < 0) {
+    logger.loge(F("OCPTH set: invalid input"));
     return false;
   }
-  
-  write(DRIVE, outgoing);
-  return logger.logSet("DRIVE", "OCPTH", value, getOCPThresh() == value);
+  return logger.logSet(drvFields::OCPTH::reg, drvFields::OCPTH::id, value, LOG_INT, set<drvFields::OCPTH>(value));
+}
+
+bool drv::setOCPThresh(OCPThreshold value) {
+  return logTyped<drvFields::OCPTH>(*this, value, LOG_INT);
 }
 
 bool drv::setOCPDeglitchTime(float value) {
-  unsigned int current = read(DRIVE) & ~0xF000;
-  unsigned int outgoing;
-
-  if (value == 1.05) {
-    outgoing = current & ~0x00C; // clear bits 3-2
-  } else if (value == 2.1) {
-    outgoing = current & ~0x00C; // clear bits 3-2
-    outgoing |= 0x004; // set bit 2
-  } else if (value == 4.2) {
-    outgoing = current & ~0x00C; // clear bits 3-2
-    outgoing |= 0x008; // set bit 3
-  } else if (value == 8.4) {
-    outgoing = current | 0x00C; // set bits 3-2
-  } else {
-    outgoing = current;
-    logger.loge("OCPDEG set: invalid input");
+  // the field table is in ns
+  long ns = (long)(value * 1000 + 0.5);
+
+  if (drvFields::OCPDEG::encode(ns) < 0) {
+    logger.loge(F("OCPDEG set: invalid input"));
     return false;
   }
+  return logger.logSet(drvFields::OCPDEG::reg, drvFields::OCPDEG::id, ns, LOG_MILLI, set<drvFields::OCPDEG>(ns));
+}
 
-  write(DRIVE, outgoing);
-  return logger.logSet("DRIVE", "OCPTH", value, getOCPDeglitchTime() == value);
+bool drv::setOCPDeglitchTime(OCPDeglitch value) {
+  return logTyped<drvFields::OCPDEG>(*this, value, LOG_MILLI);
 }
 
 bool drv::setTDriveN(int value) {
-  unsigned int current = read(DRIVE) & ~0xF000;
-  unsigned int outgoing;
-
-  if (value == 263) {
-    outgoing = current & ~0x030; // clear bits 5-4
-  } else if (value == 525) {
-    outgoing = current & ~0x030; // clear bits 5-4
-    outgoing |= 0x010; // set bit 4
-  } else if (value == 1050) {
-    outgoing = current & ~0x030; // clear bits 5-4
-    outgoing |= 0x020; // set bit 5
-  } else if (value == 2100) {
-    outgoing = current | 0x030; // set bits 5-4
-  } else {
-    outgoing = current;
-    logger.loge("TDRIVEN set: invalid input");
+  if (drvFields::TDRIVEN::encode(value) < 0) {
+    logger.loge(F("TDRIVEN set: invalid input"));
     return false;
   }
+  return logger.logSet(drvFields::TDRIVEN::reg, drvFields::TDRIVEN::id, value, LOG_INT, set<drvFields::TDRIVEN>(value));
+}
 
-  write(DRIVE, outgoing);
-  return logger.logSet("DRIVE", "TDRIVEN", value, getTDriveN() == value);
+bool drv::setTDriveN(GateDriveTime value) {
+  return logTyped<drvFields::TDRIVEN>(*this, value, LOG_INT);
 }
 
 bool drv::setTDriveP(int value) {
-  unsigned int current = read(DRIVE) & ~0xF000;
-  unsigned int outgoing;
-
-  if (value == 263) {
-    outgoing = current & ~0x0C0; // clear bits 7-6
-  } else if (value == 525) {
-    outgoing = current & ~0x0C0; // clear bits 7-6
-    outgoing |= 0x040; // set bit 6
-  } else if (value == 1050) {
-    outgoing = current & ~0x0C0; // clear bits 7-6
-    outgoing |= 0x080; // set bit 7
-  } else if (value == 2100) {
-    outgoing = current | 0x0C0; // set bits 7-6
-  } else {
-    outgoing = current;
-    logger.loge("TDRIVEP set: invalid input");
+  if (drvFields::TDRIVEP::encode(value) < 0) {
+    logger.loge(F("TDRIVEP set: invalid input"));
     return false;
   }
-  
-  write(DRIVE, outgoing);
-  return logger.logSet("DRIVE", "TDRIVEP", value, getTDriveP() == value);
+  return logger.logSet(drvFields::TDRIVEP::reg, drvFields::TDRIVEP::id, value, LOG_INT, set<drvFields::TDRIVEP>(value));
+}
+
+bool drv::setTDriveP(GateDriveTime value) {
+  return logTyped<drvFields::TDRIVEP>(*this, value, LOG_INT);
 }
 
 bool drv::setIDriveN(int value) {
-  unsigned int current = read(DRIVE) & ~0xF000;
-  unsigned int outgoing;
-
-  if (value == 100) {
-    outgoing = current & ~0x300; // clear bits 9-8
-  } else if (value == 200) {
-    outgoing = current & ~0x300; // clear bits 9-8
-    outgoing |= 0x100; // set bit 8
-  } else if (value == 300) {
-    outgoing = current & ~0x300; // clear bits 9-8
-    outgoing |= 0x200; // set bit 9
-  } else if (value == 400) {
-    outgoing = current | 0x300; // set bits 9-8
-  } else {
-    outgoing = current;
-    logger.loge("IDRIVEN set: invalid input");
+  if (drvFields::IDRIVEN::encode(value) < 0) {
+    logger.loge(F("IDRIVEN set: invalid input"));
     return false;
   }
+  return logger.logSet(drvFields::IDRIVEN::reg, drvFields::IDRIVEN::id, value, LOG_INT, set<drvFields::IDRIVEN>(value));
+}
 
-  write(DRIVE, outgoing);
-  return logger.logSet("DRIVE", "IDRIVEN", value, getIDriveN() == value);
+bool drv::setIDriveN(SinkCurrent value) {
+  return logTyped<drvFields::IDRIVEN>(*this, value, LOG_INT);
 }
 
 bool drv::setIDriveP(int value) {
-  unsigned int current = read(DRIVE) & ~0xF000;
-  unsigned int outgoing;
-
-  if (value == 50) {
-    outgoing = current & ~0xC00; // clear bits 11-10
-  } else if (value == 100) {
-    outgoing = current & ~0xC00; // clear bits 11-10
-    outgoing |= 0x400; // set bit 8
-  } else if (value == 150) {
-    outgoing = current & ~0xC00; // clear bits 11-10
-    outgoing |= 0x800; // set bit 9
-  } else if (value == 200) {
-    outgoing = current | 0xC00; // set bits 11-10
-  } else {
-    outgoing = current;
-    logger.loge("IDRIVEP set: invalid input");
+  if (drvFields::IDRIVEP::encode(value) < 0) {
+    logger.loge(F("IDRIVEP set: invalid input"));
     return false;
   }
+  return logger.logSet(drvFields::IDRIVEP::reg, drvFields::IDRIVEP::id, value, LOG_INT, set<drvFields::IDRIVEP>(value));
+}
 
-  write(DRIVE, outgoing);
-  return logger.logSet("DRIVE", "IDRIVEP", value, getIDriveP() == value);
+bool drv::setIDriveP(SourceCurrent value) {
+  return logTyped<drvFields::IDRIVEP>(*this, value, LOG_INT);
 }
 
-// *** GETTERS ***
+// *** TORQUE STREAMING ***
 
-char* drv::getHbridge() {
-  unsigned int current = read(CTRL) & 0x001;
-  char* get = "none";
+void drv::armTorqueStream(unsigned int verifyEvery) {
+  /*
+  Claim the bus for streaming. The frame keeps the TORQUE register's other
+  bits from the shadow, so each push only ORs in the new value.
+  */
+  _streamFrame = (TORQUE << 12) | (cached(TORQUE) & ~drvFields::TORQUE::mask & 0xFFF);
+  _streamVerifyEvery = verifyEvery;
+  _streamVerifiedAt = streamPushes;
+  SPI.beginTransaction(_settings);
+  _streaming = true;
+  logger.logi(F("torque stream armed"));
+}
 
-  if (current == 0) {
-    get = "off";
-  } else if (current == 1) {
-    get = "on";
+void drv::streamTorque(unsigned char value) {
+  transfer(_streamFrame | value);
+  store(TORQUE, _streamFrame | value);
+  streamPushes++;
+}
+
+bool drv::serviceTorqueStream() {
+  /*
+  Read TORQUE back inside the held transaction. Interrupts are off for the
+  one frame so a push from an ISR can't interleave with it.
+  */
+  if (!_streaming || _streamVerifyEvery == 0) {
+    return true;
   }
 
-  return get;
-}
+  noInterrupts();
+  unsigned long pushes = streamPushes;
+  if (pushes - _streamVerifiedAt < _streamVerifyEvery) {
+    interrupts();
+    return true;
+  }
+  unsigned int expected = currentRegisterValues[TORQUE];
+  unsigned int actual = transfer((TORQUE << 12) | 0x8000) & 0xFFF;
+  interrupts();
 
-int drv::getISGain() {
-  unsigned int current = read(CTRL) & 0x300;
-  int get = 0;
+  journal(TORQUE | JOURNAL_READ, expected, actual, drvFields::SOURCE_STREAM);
+
+  _streamVerifiedAt = pushes;
+  if (((actual ^ expected) & regMask(TORQUE)) == 0) {
+    return true;
+  }
+  streamErrors++;
+  return false;
+}
 
-  if (current == 0x000) {
-    get = 5;
-  } else if (current == 0x100) {
-    get = 10;
-  } else if (current == 0x200) {
-    get = 20;
-  } else if (current == 0x300) {
-    get = 40;
+void drv::disarmTorqueStream() {
+  if (!_streaming) {
+    return;
   }
+  _streaming = false;
+  SPI.endTransaction();
+  logger.logi(F("torque stream disarmed"));
+}
 
-  return get;
+bool drv::torqueStreamArmed() {
+  return _streaming;
 }
 
-int drv::getDTime() {
-  unsigned int current = read(CTRL) & 0xC00;
-  int get = 0;
+// *** GETTERS ***
 
-  if (current == 0x000) {
-    get = 410;
-  } else if (current == 0x400) {
-    get = 460;
-  } else if (current == 0x800) {
-    get = 670;
-  } else if (current == 0xC00) {
-    get = 880;
-  }
+Bridge drv::getHbridge() {
+  return get<drvFields::ENBL, Bridge>();
+}
 
-  return get;
+int drv::getISGain() {
+  return get<drvFields::ISGAIN>();
+}
+
+int drv::getDTime() {
+  return get<drvFields::DTIME>();
 }
 
 unsigned int drv::getTorque() {
-  return read(TORQUE) & 0x0FF;
+  return get<drvFields::TORQUE>();
 }
 
 unsigned int drv::getTOff() {
-  return read(OFF) & 0x0FF;
+  return get<drvFields::TOFF>();
 }
 
 unsigned int drv::getTBlank() {
-  return read(BLANK) & 0x0FF;
+  return get<drvFields::TBLANK>();
 }
 
 unsigned int drv::getTDecay() {
-  return read(DECAY) & 0x0FF;
+  return get<drvFields::TDECAY>();
 }
 
-char* drv::getDecMode() {
-  unsigned int current = read(DECAY) & 0x700;
-  char* get = "none";
+Decay drv::getDecMode() {
+  return get<drvFields::DECMOD, Decay>();
+}
 
-  if (current == 0x000) {
-    get = "slow";
-  } else if (current == 0x200) {
-    get = "fast";
-  } else if (current == 0x300) {
-    get = "mixed";
-  } else if (current == 0x500) {
-    get = "auto";
-  }
+int drv::getOCPThresh() {
+  return get<drvFields::OCPTH>();
+}
 
-  return get;
+float drv::getOCPDeglitchTime() {
+  return get<drvFields::OCPDEG>() / 1000.0;
 }
 
-int drv::getOCPThresh() {
-  unsigned int current = read(DRIVE) & 0x003;
-  int get = 0;
+int drv::getTDriveN() {
+  return get<drvFields::TDRIVEN>();
+}
 
-  if (current == 0x000) {
-    get = 250;
-  } else if (current == 0x001) {
-    get = 500;
-  } else if (current == 0x002) {
-    get = 750;
-  } else if (current == 0x003) {
-    get = 1000;
+int drv::getTDriveP() {
+  return get<drvFields::TDRIVEP>();
+}
+
+int drv::getIDriveN() {
+  return get<drvFields::IDRIVEN>();
+}
+
+int drv::getIDriveP() {
+  return get<drvFields::IDRIVEP>();
+}
+
+void drv::getFault() {
+  JournalScope scope(*this, drvFields::SOURCE_FAULT);
+  updateFaults(read(STATUS) & 0x03F);
+}
+
+void drv::updateFaults(unsigned char status) {
+  /*
+  Track which faults are active, count and timestamp newly raised ones,
+  report them and clear the latched ones the monitor was asked to clear.
+  */
+  unsigned long now = micros();
+  unsigned char raised = status & ~activeFaults;
+
+  for (int i = 0; i < 6; i++) {
+    faults[i] = status & (1 << i);
+    if (raised & (1 << i)) {
+      faultCounts[i]++;
+      if (faultFirstSeen[i] == 0) {
+        faultFirstSeen[i] = now;
+      }
+    }
+    if (faults[i]) {
+      faultLastSeen[i] = now;
+    }
+  }
+  activeFaults = status;
+
+  if (raised) {
+    logger.loge(F("fault raised"));
+    if (_faultCallback) {
+      _faultCallback(*this, status, raised);
+    }
   }
 
-  return get;
+  unsigned char clear = status & _faultAutoClear & (FAULT_AOCP | FAULT_BOCP | FAULT_APDF | FAULT_BPDF);
+  if (clear) {
+    clearFaults(clear);
+    // still low: a fault that isn't auto cleared, or one latched since the read
+    if (_faultPin >= 0 && digitalRead(_faultPin) == LOW) {
+      _faultPending = true;
+    }
+  }
 }
 
-float drv::getOCPDeglitchTime() {
-  unsigned int current = read(DRIVE) & 0x00C;
-  float get = 0;
+bool drv::beginFaultMonitor(int faultPin, FaultCallback callback, unsigned char autoClear) {
+  int slot = 0;
+  while (slot < MAX_FAULT_MONITORS && faultMonitors[slot] != NULL && faultMonitors[slot] != this) {
+    slot++;
+  }
+  if (slot == MAX_FAULT_MONITORS) {
+    logger.loge(F("fault monitor: no free slot"));
+    return false;
+  }
+  faultMonitors[slot] = this;
+
+  _faultPin = faultPin;
+  _faultCallback = callback;
+  _faultAutoClear = autoClear;
+  pinMode(faultPin, INPUT_PULLUP); // nFAULT is open drain
 
-  if (current == 0x000) {
-    get = 1.05;
-  } else if (current == 0x002) {
-    get = 2.1;
-  } else if (current == 0x004) {
-    get = 4.2;
-  } else if (current == 0x00C) {
-    get = 8.4;
+  int interrupt = digitalPinToInterrupt(faultPin);
+  if (interrupt != NOT_AN_INTERRUPT) {
+    attachInterrupt(interrupt, faultInterrupts[slot], FALLING);
+    _faultInterrupt = true;
+  } else {
+#ifdef DRV_USE_PCINT
+    *digitalPinToPCMSK(faultPin) |= _BV(digitalPinToPCMSKbit(faultPin));
+    PCICR |= _BV(digitalPinToPCICRbit(faultPin));
+    _faultInterrupt = true;
+#else
+    _faultInterrupt = false;
+#endif
   }
 
-  return get;
+  // a fault raised before the monitor started has no edge left to catch
+  _faultPending = digitalRead(faultPin) == LOW;
+  return true;
 }
 
-int drv::getTDriveN() {
-  unsigned int current = read(DRIVE) & 0x030;
-  int get = 0;
+void drv::onFaultInterrupt() {
+  // pin change interrupts fire on both edges, only a low nFAULT needs a read
+  if (digitalRead(_faultPin) == LOW) {
+    _faultPending = true;
+  }
+}
 
-  if (current == 0x000) {
-    get = 263;
-  } else if (current == 0x010) {
-    get = 525;
-  } else if (current == 0x020) {
-    get = 1050;
-  } else if (current == 0x030) {
-    get = 2100;
+bool drv::serviceFaults() {
+  /*
+  No SPI while nFAULT stays high. A high pin also means STATUS is clear,
+  so recovered faults are dropped without reading it. A low pin with
+  faults already known gives no edge for a new one, so STATUS is read
+  again every FAULT_RECHECK_MICROS.
+  */
+  if (_faultPin < 0) {
+    return false;
+  }
+
+  bool asserted = digitalRead(_faultPin) == LOW;
+
+  if (!_faultInterrupt && asserted && activeFaults == 0) {
+    _faultPending = true; // polled
+  }
+  if (asserted && activeFaults != 0 && micros() - _faultReadAt >= FAULT_RECHECK_MICROS) {
+    _faultPending = true; // a fault raised behind the first one
+  }
+
+  if (_faultPending) {
+    _faultPending = false;
+    _faultReadAt = micros();
+    getFault();
+  } else if (!asserted && activeFaults != 0) {
+    updateFaults(0);
+    currentRegisterValues[STATUS] = 0;
   }
 
-  return get;
+  return activeFaults != 0;
 }
 
-int drv::getTDriveP() {
-  unsigned int current = read(DRIVE) & 0x0C0;
-  int get = 0;
+void drv::clearFaults(unsigned char bits) {
+  /*
+  Writing 0 to a STATUS bit clears it, 1s leave the other bits alone.
+  */
+  JournalScope scope(*this, drvFields::SOURCE_FAULT);
+  write(STATUS, ~bits & 0x03F);
+  currentRegisterValues[STATUS] = activeFaults & ~bits;
+}
+
+void drv::clearFault(int value) {
+  clearFaults(1 << value);
+}
 
-  if (current == 0x000) {
-    get = 263;
-  } else if (current == 0x040) {
-    get = 525;
-  } else if (current == 0x080) {
-    get = 1050;
-  } else if (current == 0x0C0) {
-    get = 2100;
+// *** REGISTER JOURNAL ***
+
+static_assert((DRV_JOURNAL_SIZE & (DRV_JOURNAL_SIZE - 1)) == 0 && DRV_JOURNAL_SIZE <= 128,
+              "DRV_JOURNAL_SIZE must be a power of two up to 128");
+
+void drv::journal(unsigned char address, unsigned int oldValue, unsigned int newValue, unsigned char source) {
+  /*
+  One slot overwrite per access, the oldest entry is dropped when full.
+  */
+  if (!_journalOn) {
+    return;
+  }
+  if (_dumpLeft > 0 && _journalNext == _dumpSlot) {
+    // the oldest unsent entry of a dump is about to go
+    _dumpSlot = (_dumpSlot + 1) & (DRV_JOURNAL_SIZE - 1);
+    _dumpLeft--;
+  }
+  JournalEntry& entry = _journal[_journalNext];
+  entry.micros = micros();
+  entry.address = address;
+  entry.source = source;
+  entry.oldValue = oldValue;
+  entry.newValue = newValue;
+
+  _journalNext = (_journalNext + 1) & (DRV_JOURNAL_SIZE - 1);
+  if (_journalLength < DRV_JOURNAL_SIZE) {
+    _journalLength++;
   }
+}
 
-  return get;
+void drv::setJournal(bool on) {
+  _journalOn = on;
 }
 
-int drv::getIDriveN() {
-  unsigned int current = read(DRIVE) & 0x300;
-  int get = 0;
+unsigned int drv::journalLength() {
+  return _journalLength;
+}
 
-  if (current == 0x000) {
-    get = 100;
-  } else if (current == 0x100) {
-    get = 200;
-  } else if (current == 0x200) {
-    get = 300;
-  } else if (current == 0x300) {
-    get = 400;
+bool drv::journalEntry(unsigned int age, JournalEntry& entry) {
+  if (age >= _journalLength) {
+    return false;
   }
+  entry = _journal[(_journalNext - 1 - age) & (DRV_JOURNAL_SIZE - 1)];
+  return true;
+}
 
-  return get;
+void drv::dumpJournal() {
+  JournalEntry entry;
+  for (int age = _journalLength - 1; age >= 0; age--) {
+    // make room for a record, the text transport never queues
+    while (logger.drain() > LOG_BUFFER_SIZE / 2) {
+    }
+    journalEntry(age, entry);
+    logger.logRegister(entry.micros, entry.address, entry.source, entry.oldValue, entry.newValue);
+  }
 }
 
-int drv::getIDriveP() {
-  unsigned int current = read(DRIVE) & 0xC00;
-  int get = 0;
+bool drv::beginJournalDump() {
+  if (logger.transport() != LOG_BINARY) {
+    logger.loge(F("journal dump: needs the binary transport"));
+    return false;
+  }
+  InterruptLock lock; // drvAsync journals from its interrupt
+  _dumpSlot = (_journalNext - _journalLength) & (DRV_JOURNAL_SIZE - 1);
+  _dumpLeft = _journalLength;
+  return true;
+}
 
-  if (current == 0x000) {
-    get = 50;
-  } else if (current == 0x400) {
-    get = 100;
-  } else if (current == 0x800) {
-    get = 150;
-  } else if (current == 0xC00) {
-    get = 200;
+bool drv::serviceJournalDump() {
+  /*
+  At most one record per call, and only while the binary ring has room,
+  so a fault callback or task never waits on the serial port.
+  */
+  if (_dumpLeft == 0) {
+    return false;
+  }
+  if (logger.transport() != LOG_BINARY) {
+    _dumpLeft = 0; // switched to text since beginJournalDump
+    return false;
+  }
+  if (logger.drain() > LOG_BUFFER_SIZE / 2) {
+    return true;
   }
 
-  return get;
+  JournalEntry entry;
+  {
+    InterruptLock lock;
+    entry = _journal[_dumpSlot];
+    _dumpSlot = (_dumpSlot + 1) & (DRV_JOURNAL_SIZE - 1);
+    _dumpLeft--;
+  }
+  logger.logRegister(entry.micros, entry.address, entry.source, entry.oldValue, entry.newValue);
+  return _dumpLeft > 0;
 }
 
-void drv::getFault() {
-  unsigned int current = read(STATUS) & 0x03F;
-  if (current & 0x1) {
-    faults[0] = true;
+void drv::clearJournal() {
+  InterruptLock lock;
+  _journalLength = 0;
+  _dumpLeft = 0;
+}
+
+// *** POWER MANAGEMENT ***
+
+// the chip's register values after power on or sleep
+const unsigned int drv::resetRegs[8] PROGMEM = {
+    0x300, // CTRL    bridge disabled, ISGAIN 40, DTIME 410 ns
+    0x0FF, // TORQUE
+    0x030, // OFF     PWMMODE 0, TOFF 48
+    0x080, // BLANK
+    0x010, // DECAY
+    0x000, // RESERVED register (unused)
+    0xFA5, // DRIVE   IDRIVEP 200, IDRIVEN 400, TDRIVE 1050/1050, OCPDEG 2.1, OCPTH 500
+    0x000, // STATUS
+};
+
+void drv::setSleepPin(int pin) {
+  _sleepPin = pin;
+  pinMode(_sleepPin, OUTPUT);
+  digitalWrite(_sleepPin, HIGH);
+}
+
+void drv::sleep() {
+  /*
+  The shadow is seeded first so it holds the whole configuration while
+  the chip's registers are reset.
+  */
+  if (_sleepPin < 0) {
+    logger.loge(F("sleep: no sleep pin"));
+    return;
   }
-  if (current & 0x2) {
-    faults[1] = true;
+  if (_power == POWER_ASLEEP) {
+    return;
   }
-  if (current & 0x4) {
-    faults[2] = true;
+  cached(CTRL);
+  digitalWrite(_sleepPin, LOW);
+  _power = POWER_ASLEEP;
+  currentRegisterValues[STATUS] = 0; // faults are reset too
+  logger.logi(F("asleep"));
+}
+
+bool drv::wake(bool wait) {
+  if (_power != POWER_ASLEEP) {
+    return ready();
   }
-  if (current & 0x8) {
-    faults[3] = true;
+  digitalWrite(_sleepPin, HIGH);
+  _wakeStarted = micros();
+  _power = POWER_WAKING;
+
+  if (wait) {
+    delayMicroseconds(WAKE_MICROS);
   }
-  if (current & 0x10) {
-    faults[4] = true;
+  return serviceWake();
+}
+
+bool drv::serviceWake() {
+  /*
+  Once the chip is up, write back only the registers whose shadow value
+  differs from the chip's reset value, in one batch.
+  */
+  if (_power != POWER_WAKING) {
+    return ready();
+  }
+  if (micros() - _wakeStarted < WAKE_MICROS) {
+    return false;
+  }
+
+  JournalScope scope(*this, drvFields::SOURCE_WAKE);
+  unsigned int images[8];
+  unsigned int reference[8];
+  for (int i = 0; i < 8; i++) {
+    images[i] = currentRegisterValues[i];
+    reference[i] = pgm_read_word(&resetRegs[i]);
   }
-  if (current & 0x20) {
-    faults[5] = true;
+
+  _power = POWER_AWAKE;
+  if (writeImages(images, reference) < 0) {
+    logger.loge(F("wake: readback mismatch"));
+  } else {
+    logger.logi(F("awake"));
   }
+  return true;
+}
 
+bool drv::ready() {
+  return _power == POWER_AWAKE;
 }
 
-void drv::clearFault(int value) {
-  write(STATUS, 0<<value); 
-}
\ No newline at end of file
+bool drv::asleep() {
+  return _power == POWER_ASLEEP;
+}
@@ -19,6 +19,38 @@
 
 #include <Arduino.h>
 #include <SPI.h>
+#include "Logger.h"
+#include "drvFields.h"
+#include "drvProfile.h"
+
+// entries kept by the register journal, a power of two
+#ifndef DRV_JOURNAL_SIZE
+#define DRV_JOURNAL_SIZE 16
+#endif
+
+/*
+masks interrupts for its lifetime. On AVR (SREG) and ARM (PRIMASK) it puts
+the interrupt flag back as it found it, so it nests and is safe inside
+ISRs. Other targets have no portable way to read the flag: there it turns
+interrupts back on, so don't take it from an ISR there.
+*/
+class InterruptLock {
+    public:
+#if defined(__AVR__)
+        InterruptLock() : _sreg(SREG) { cli(); }
+        ~InterruptLock() { SREG = _sreg; }
+    private:
+        uint8_t _sreg;
+#elif defined(__arm__)
+        InterruptLock() : _primask(__get_PRIMASK()) { __disable_irq(); }
+        ~InterruptLock() { __set_PRIMASK(_primask); }
+    private:
+        uint32_t _primask;
+#else
+        InterruptLock() { noInterrupts(); }
+        ~InterruptLock() { interrupts(); }
+#endif
+};
 
 class drv {
     public:
@@ -31,8 +63,29 @@ class drv {
         int _SCLK;
         int _SCS;
 
-        // faults
-        bool faults[];
+        // faults, indexed by STATUS bit (see getFault)
+        bool faults[6];
+
+        // STATUS fault bits
+        static const unsigned char FAULT_OTS = 0x01;
+        static const unsigned char FAULT_AOCP = 0x02;
+        static const unsigned char FAULT_BOCP = 0x04;
+        static const unsigned char FAULT_APDF = 0x08;
+        static const unsigned char FAULT_BPDF = 0x10;
+        static const unsigned char FAULT_UVLO = 0x20;
+
+        /*
+        called from serviceFaults when a fault is raised
+        faults: all currently active fault bits
+        raised: bits that weren't active before
+        */
+        typedef void (*FaultCallback)(drv& device, unsigned char faults, unsigned char raised);
+
+        // fault monitor state (see beginFaultMonitor)
+        unsigned char activeFaults;
+        unsigned int faultCounts[6];
+        unsigned long faultFirstSeen[6]; // micros
+        unsigned long faultLastSeen[6];  // micros
         
         
         // register addresses
@@ -44,10 +97,37 @@ class drv {
         const int DRIVE = 0x6;
         const int STATUS = 0x7;
 
+        // shadow copy of the chip's registers (12 bit values, see syncRegisters)
         unsigned int currentRegisterValues[8];
 
         // Default reg values
-        unsigned int initRegs[];
+        unsigned int initRegs[8];
+
+        // max number of frames queued in one batch (see beginBatch)
+        static const int BATCH_SIZE = 16;
+
+        // bus timing counters, per-call path (read/write) vs batches (runBatch)
+        struct Timing {
+            unsigned long singleMicros;
+            unsigned long singleFrames;
+            unsigned long batchMicros;
+            unsigned long batchFrames;
+        };
+
+        Timing timing;
+
+        // every SPI frame sent to the chip, whichever path sent it
+        unsigned long frameCount;
+
+        // readbacks that disagreed with the shadow (verify, profiles, wake)
+        unsigned int verifyErrors;
+
+        // shadow register verify policies (see setVerifyPolicy)
+        enum VerifyPolicy {
+            VERIFY_NEVER,   // trust the shadow, never read back after a write
+            VERIFY_EVERY_N, // read back every Nth write
+            VERIFY_ON_FAULT // read back only while the FAULT pin is asserted (low)
+        };
 
         // functions 
         
@@ -60,6 +140,48 @@ class drv {
         closes SPI bus
         */
         void close();
+
+        /*
+        SPI settings used for every transaction with the chip
+        */
+        SPISettings settings();
+
+        /*
+        SPI clock in Hz
+        */
+        unsigned long clock();
+
+        /*
+        sets the SPI clock for every following transaction (140 kHz default)
+        */
+        void setClock(unsigned long hz);
+
+        // clock rates tried by autoTuneClock, slowest first (in flash, pgm_read_dword)
+        static const int CLOCK_STEPS = 6;
+        static const unsigned long clockSteps[CLOCK_STEPS];
+
+        // one autoTuneClock step
+        struct ClockResult {
+            unsigned long hz;
+            unsigned int errors;      // mismatched readbacks
+            unsigned int frameMicros; // average time per frame, read()/write() included
+        };
+
+        /*
+        finds the fastest reliable SPI clock. Steps up through clockSteps
+        writing and reading back test patterns on TORQUE and BLANK until a
+        rate shows errors, then settles one step below the fastest clean
+        rate as a safety margin. TORQUE and BLANK are restored afterwards,
+        and every writable register is read back against its saved value
+        (a corrupted frame can write anywhere) and rewritten if it differs.
+        The bridge must be disabled (ENBL off), since TORQUE is rewritten.
+        report: receives one result per rate tried (CLOCK_STEPS entries, can be NULL)
+        returns the clock chosen, the current one if the bridge is on, 0 if
+        no rate was clean (the clock is left at the slower of the original
+        and the slowest step) or a register didn't read back as saved
+        (the shadow keeps the saved values)
+        */
+        unsigned long autoTuneClock(ClockResult* report = NULL);
         
         /*
         reads from given address
@@ -68,14 +190,58 @@ class drv {
 
         /*
         writes value to address
-        returns true if successful
+        returns false if a sampled readback (see setReliability) kept
+        disagreeing after every retry
         */
-        void write(unsigned int address, unsigned int value);
+        bool write(unsigned int address, unsigned int value);
         
+        /*
+        starts a new batch, dropping anything queued and not run
+        */
+        void beginBatch();
+
+        /*
+        queues a register read in the current batch
+        returns the index of the result (see batchResult), -1 if the batch is full
+        */
+        int queueRead(unsigned int address);
+
+        /*
+        queues a register write in the current batch
+        returns false if the batch is full
+        */
+        bool queueWrite(unsigned int address, unsigned int value);
+
+        /*
+        runs all queued frames inside one SPI transaction, only toggling SCS
+        between frames. reads and writes update the shadow registers.
+        returns the number of frames transferred
+        */
+        int runBatch();
+
+        /*
+        12 bit value of a queued read after runBatch
+        index: value returned by queueRead
+        */
+        unsigned int batchResult(int index);
+
+        /*
+        microseconds the batches so far saved compared with sending the
+        same number of frames through read()/write() (negative if slower)
+        */
+        long batchSavedMicros();
+
+        /*
+        clears the timing counters
+        */
+        void resetTiming();
+
         /*
         sets logging level for DRV logger object (see Logger.h)
         */
         void setLogging(char* level);
+
+        void setLogging(LogLevel level);
         
         /*
         reads all registers and stores in currentRegisterValues
@@ -83,25 +249,131 @@ class drv {
         void getCurrentRegisters();
 
         /*
-        confirms that all Regs have desired values
-        desiredRegs[]: array with 7 entries each with 12 bit values (one for each reg)
+        seeds the shadow registers from the chip (all 8 registers)
+        called automatically the first time a getter or setter needs the shadow
         */
-        void regDiagnostic(int desiredRegs[]);
+        void syncRegisters();
+
+        /*
+        returns the shadowed 12 bit value of a register without touching the bus
+        */
+        unsigned int cached(unsigned int address);
+
+        /*
+        reads a register back and compares it with its shadow value
+        on mismatch the shadow is resynced from the chip
+        returns true if chip and shadow agree
+        */
+        bool verify(unsigned int address);
+
+        /*
+        sets when setters read back what they wrote
+        policy:
+            VERIFY_NEVER - setters trust the shadow
+            VERIFY_EVERY_N - every n-th write is read back (n = 1 verifies every write)
+            VERIFY_ON_FAULT - writes are read back while faultPin reads LOW
+        faultPin: only read by VERIFY_ON_FAULT, the fault monitor keeps the
+            pin given to beginFaultMonitor
+        */
+        void setVerifyPolicy(VerifyPolicy policy, unsigned int n = 1, int faultPin = -1);
+
+        /*
+        writes a whole configuration in one batch, skipping registers whose
+        shadow already holds the profile's values. When the profile enables
+        the bridge CTRL is written last, when it disables it CTRL goes first.
+        If the verify policy calls for it the written registers are read back
+        in the same batch.
+        returns false if a setting is out of range or a readback disagreed
+        */
+        bool applyProfile(const DrvProfile& profile);
+
+        /*
+        applyProfile for a profile stored in flash (PROGMEM)
+        */
+        bool applyProfile_P(const DrvProfile* profile);
+
+        // EEPROM bytes taken by a saved profile (profile and checksum)
+        static const int PROFILE_EEPROM_SIZE = sizeof(DrvProfile) + 1;
+
+        /*
+        stores a profile in EEPROM at address, only changed bytes are written
+        returns false if a setting is out of range
+        */
+        bool saveProfile(const DrvProfile& profile, int address);
+
+        /*
+        reads a profile saved with saveProfile
+        returns false if address holds no valid profile (profile is then undefined)
+        */
+        bool loadProfile(DrvProfile& profile, int address);
+
+        // regDiagnostic bit for STATUS (fault bits) not matching
+        static const unsigned int DIAG_STATUS = 1u << drvFields::FIELD_COUNT;
+
+        /*
+        confirms that all Regs have desired values, from one batched snapshot
+        (7 frames). Mismatches are logged by field name when errors are logged.
+        desiredRegs[]: array with 8 entries each with 12 bit values (one for each reg)
+        returns a bitmap of the fields that don't match (bit n is drvFields::FieldId n,
+            DIAG_STATUS for STATUS), 0 if all registers are as desired
+        */
+        unsigned int regDiagnostic(const unsigned int desiredRegs[]);
 
         
         // *** SETTERS ***
 
+        /*
+        sets any field described in drvFields.h
+        value: what the field's setter takes (see drvFields.h for units)
+        returns false if value isn't valid for the field or the write didn't verify
+        */
+        template <class Field>
+        bool set(long value) {
+            int code = Field::encode(value);
+            if (code < 0) {
+                return false;
+            }
+            JournalScope scope(*this, Field::id);
+            return writeField(Field::reg, Field::mask, (unsigned int)code << Field::shift);
+        }
+
+        /*
+        gets any field described in drvFields.h from the shadow registers
+        */
+        template <class Field>
+        int get() {
+            return Field::decode((cached(Field::reg) & Field::mask) >> Field::shift);
+        }
+
+        /*
+        sets a field from its typed setting (see TYPED SETTINGS in drvFields.h),
+        the setting is the field code so nothing is looked up
+        */
+        template <class Field, class Setting>
+        typename drvTypedSetting<Setting, bool>::type set(Setting value) {
+            JournalScope scope(*this, Field::id);
+            return writeField(Field::reg, Field::mask, (unsigned int)value << Field::shift);
+        }
+
+        /*
+        gets a field as its typed setting, e.g. get<drvFields::DECMOD, Decay>()
+        */
+        template <class Field, class Setting>
+        Setting get() {
+            return (Setting)((cached(Field::reg) & Field::mask) >> Field::shift);
+        }
+
 
         // following funcs deal with CTRL register
 
         /*
         sets ENBL register
         value: 
-            "on" - turns on h-bridge
-            "off" ("on" default)
+            Bridge::On - turns on h-bridge
+            Bridge::Off (Bridge::On default)
         returns true if successful
         */
-        bool setHbridge(char* value);
+        bool setHbridge(Bridge value);
 
         /*
         sets ISGAIN register
@@ -112,6 +384,8 @@ class drv {
         */
         bool setISGain(int value);
 
+        bool setISGain(ISGain value);
+
         /*
         sets DTIME register
         value:
@@ -121,6 +395,8 @@ class drv {
         */
         bool setDTime(int value);
 
+        bool setDTime(DeadTime value);
+
         // following func deals with TORQUE register
 
         /*
@@ -163,13 +439,13 @@ class drv {
         /*
         sets DECMODE register
         value: 
-            "slow" - force slow decay at all times (default)
-            "fast" - force fast decay at all times
-            "mixed" - use mixed decay at all times
-            "auto" - use auto mixed decay at all times
+            Decay::Slow - force slow decay at all times (default)
+            Decay::Fast - force fast decay at all times
+            Decay::Mixed - use mixed decay at all times
+            Decay::Auto - use auto mixed decay at all times
         returns true if successful
         */
-        bool setDecMode(char* value);
+        bool setDecMode(Decay value);
 
         // following funcs deal with DRIVE register
 
@@ -182,6 +458,8 @@ class drv {
         */
         bool setOCPThresh(int value);
 
+        bool setOCPThresh(OCPThreshold value);
+
         /*
         sets OCPDEG register 
         value:
@@ -191,6 +469,8 @@ class drv {
         */
         bool setOCPDeglitchTime(float value);
 
+        bool setOCPDeglitchTime(OCPDeglitch value);
+
         /*
         sets TDRIVEN register
         value:
@@ -199,6 +479,8 @@ class drv {
         returns true if successful
         */
         bool setTDriveN(int value);
+
+        bool setTDriveN(GateDriveTime value);
         
         /*
         sets TDRIVEP register
@@ -209,6 +491,8 @@ class drv {
         */
         bool setTDriveP(int value);
 
+        bool setTDriveP(GateDriveTime value);
+
         /*
         sets IDRIVEN register
         value:
@@ -218,6 +502,8 @@ class drv {
         */
         bool setIDriveN(int value);
 
+        bool setIDriveN(SinkCurrent value);
+
         /*
         sets IDRIVEP register
         value:
@@ -227,12 +513,50 @@ class drv {
         */
         bool setIDriveP(int value);
 
+        bool setIDriveP(SourceCurrent value);
+
+
+
+        // *** TORQUE STREAMING ***
+
+        /*
+        arms torque streaming: claims the SPI bus and pre-encodes the TORQUE
+        frame from the shadow. While armed nothing else may use the bus
+        except serviceTorqueStream.
+        verifyEvery: serviceTorqueStream reads TORQUE back once this many
+            values have been pushed since the last check (0 never verifies)
+        */
+        void armTorqueStream(unsigned int verifyEvery = 0);
+
+        /*
+        pushes a torque value (0-255) as one bare TORQUE frame
+        no range check, readback or logging, can be called from a timer ISR
+        */
+        void streamTorque(unsigned char value);
+
+        /*
+        out of band check of the streamed torque, call from loop()
+        returns false if TORQUE read back differently than last pushed
+        */
+        bool serviceTorqueStream();
+
+        /*
+        releases the SPI bus
+        */
+        void disarmTorqueStream();
+
+        bool torqueStreamArmed();
+
+        // streaming counters
+        volatile unsigned long streamPushes;
+        unsigned int streamErrors;
 
 
         // *** GETTERS ***
-        // all getters return the value one would pass the corresponding setter
+        // all getters return the value one would pass the corresponding setter,
+        // typed settings of the other discrete fields come from get<Field, Setting>()
 
-        char* getHbridge();
+        Bridge getHbridge();
 
         int getISGain();
 
@@ -246,7 +570,8 @@ class drv {
 
         unsigned int getTDecay();
 
-        char* getDecMode();
+        // Decay values other than the four named ones are reserved codes
+        Decay getDecMode();
 
         int getOCPThresh();
 
@@ -261,13 +586,49 @@ class drv {
         int getIDriveP();
         
         /*
-        Returns bits 0-5 of STATUS register
+        Reads bits 0-5 of STATUS register into faults[] and activeFaults
         */
   
         void getFault();
 
+        /*
+        watches the nFAULT pin (active low) for faults
+        the pin's external or pin change interrupt only flags that STATUS
+        needs reading, serviceFaults does the read, so no SPI runs in the ISR.
+        Without an interrupt for the pin serviceFaults polls the pin level.
+        nFAULT stays low while any fault is, so a second fault has no edge:
+        while the pin is low serviceFaults reads STATUS again every
+        FAULT_RECHECK_MICROS, and right after an auto clear.
+        faultPin: pin wired to nFAULT
+        callback: called when faults are raised (can be NULL)
+        autoClear: latched faults (AOCP, BOCP, APDF, BPDF) cleared as soon as
+            they have been reported, OTS and UVLO clear themselves
+        returns false if no more devices can be monitored
+        */
+        bool beginFaultMonitor(int faultPin, FaultCallback callback = NULL, unsigned char autoClear = 0);
+
+        /*
+        call from loop(), reads STATUS only if nFAULT has signalled
+        returns true if a fault is active
+        */
+        bool serviceFaults();
+
+        // STATUS re-read period while nFAULT stays low
+        static const unsigned long FAULT_RECHECK_MICROS = 10000;
+
+        /*
+        flags a STATUS read for the next serviceFaults (called from the ISR)
+        */
+        void onFaultInterrupt();
+
 
                 
+        /*
+        clears latched faults
+        bits: FAULT_ bits to clear
+        */
+        void clearFaults(unsigned char bits);
+
         /*
         clears a Fault if there is one.
         value: OTS - over temp                  (0) (auto clear)
@@ -280,6 +641,393 @@ class drv {
         */
         void clearFault(int value);
 
+
+        // *** REGISTER JOURNAL ***
+        // every register write, readback and STATUS read is recorded in a
+        // circular journal, the newest DRV_JOURNAL_SIZE entries are kept.
+        // Streamed torque pushes are only counted (streamPushes).
+
+        // one register access
+        struct JournalEntry {
+            unsigned long micros;
+            unsigned char address;  // register, JOURNAL_READ set for reads
+            unsigned char source;   // setter's drvFields::FieldId or a drvFields::Source
+            unsigned int oldValue;  // shadow value before the access
+            unsigned int newValue;  // value written or read
+        };
+
+        static const unsigned char JOURNAL_READ = 0x80;
+
+        /*
+        turns recording on or off (on by default)
+        */
+        void setJournal(bool on);
+
+        /*
+        number of entries held
+        */
+        unsigned int journalLength();
+
+        /*
+        copies an entry, age 0 is the newest
+        returns false if there is no entry that old
+        */
+        bool journalEntry(unsigned int age, JournalEntry& entry);
+
+        /*
+        logs every entry, oldest first, through the drv logger (global level,
+        see Logger::logRegister). Blocks while the binary transport drains,
+        so not for fault callbacks or tasks, use beginJournalDump there.
+        */
+        void dumpJournal();
+
+        /*
+        starts logging the entries held, oldest first, one per
+        serviceJournalDump call. An entry overwritten before it is sent is
+        skipped, later accesses aren't part of the dump.
+        Needs the binary transport: a text line is longer than Serial's
+        transmit buffer, so it can't be sent without blocking.
+        returns false, and dumps nothing, with the text transport
+        */
+        bool beginJournalDump();
+
+        /*
+        call from loop() or a low priority task, logs the next entry of the
+        dump unless the binary transport is still more than half full
+        returns true while entries are left
+        */
+        bool serviceJournalDump();
+
+        void clearJournal();
+
+
+        // *** POWER MANAGEMENT ***
+
+        // time the chip needs after nSLEEP rises before it takes frames (tWAKE)
+        static const unsigned int WAKE_MICROS = 1000;
+
+        // the chip's register values after power on or sleep (in flash, pgm_read_word)
+        static const unsigned int resetRegs[8];
+
+        /*
+        sets the pin wired to nSLEEP and drives it high (awake)
+        */
+        void setSleepPin(int pin);
+
+        /*
+        drives nSLEEP low. The chip resets its registers and stops taking
+        frames, the shadow keeps the configuration. Setters called while
+        asleep only change the shadow, wake writes them. Don't use read(),
+        write() or batches until ready().
+        */
+        void sleep();
+
+        /*
+        raises nSLEEP and restores the registers that differ from the chip's
+        reset values (resetRegs), from the shadow in one batch
+        wait: block for WAKE_MICROS and restore now, otherwise serviceWake
+            restores once the wake time has passed
+        returns ready()
+        */
+        bool wake(bool wait = true);
+
+        /*
+        call from loop() after wake(false)
+        returns true once the registers are restored
+        */
+        bool serviceWake();
+
+        /*
+        true when awake and restored, the bridge runs with the shadow's settings
+        */
+        bool ready();
+
+        bool asleep();
+
+
+
+        // *** SPI RELIABILITY ***
+
+        /*
+        called once when the bus fails (see setReliability), e.g. to sleep
+        the chip or stop the PWM. The bus keeps being used afterwards.
+        */
+        typedef void (*BusFailureCallback)(drv& device);
+
+        /*
+        sets how read() and write() guard frames (runBatch re-reads bad
+        read frames through read())
+        Every read frame is checked: its reserved bits (see regMasks) must
+        read 0 and it can't be 0xFFFF (MISO stuck high). Writes are read
+        back once every readbackEvery writes (0 never, 1 every write, STATUS
+        excluded since writing it clears faults), which also catches a MISO
+        stuck low. A bad frame is sent again up to retries times, waiting
+        backoffMicros, then twice that, ... between attempts.
+        failLimit transfers in a row failing every retry mark the bus failed
+        and call the callback.
+        Defaults: 2 retries, 20 us backoff, no readback, failLimit 3.
+        */
+        void setReliability(unsigned char retries, unsigned int backoffMicros,
+                            unsigned int readbackEvery = 0, unsigned char failLimit = 3);
+
+        void onBusFailure(BusFailureCallback callback);
+
+        /*
+        false once the bus has failed, until clearBusFailure
+        */
+        bool busHealthy();
+
+        void clearBusFailure();
+
+        // SPI reliability counters
+        unsigned int regErrors[8]; // bad frames per register, retried or not
+        unsigned int busRetries;   // frames sent again after a failed check
+        unsigned int busFailures;  // transfers that failed every retry
+
+
+
+        // *** ISR SAFE ***
+        /*
+        The isr calls below can be made from a timer or fault ISR, or from
+        loop() while such an ISR may fire. Each is one SPI frame built from
+        its register address and the shadow: no allocation, no logging, no
+        strings, no retries, journal or fault bookkeeping. They rely on the
+        constructor having set up the SPI settings and the SCS port, and on
+        the sketch having configured the SPI pins (SCS an output) before the
+        ISR that calls them is enabled.
+
+        Every frame drv sends, on any path, runs with interrupts masked from
+        SCS rising to SCS falling, so an isr frame can only land between two
+        frames, never inside one. It may land inside an open transaction
+        (a batch, the torque stream, drvBus), so it loads its own SPI
+        settings and puts the previous ones back afterwards. Shadow updates
+        are masked the same way.
+
+        Latency, 16 / SPI clock per frame plus a few us of pin and register
+        work (16 MHz AVR): ~130 us at the 140 kHz default (125 kHz actual),
+        ~20 us at 1 MHz, ~8 us at 4 MHz. From the ISR starting to the bridge
+        being off is at most two frames, the isr frame itself plus the rest
+        of a frame it waited for. Other interrupts are held off for at most
+        one frame by drv.
+
+        Reentrancy: the isr calls don't nest with each other (ISRs run with
+        interrupts off, and on AVR and ARM the calls restore the interrupt
+        flag as they found it, see InterruptLock). On other targets they
+        turn interrupts back on, call them from loop() there. Not safe while drvAsync has requests in flight, its
+        frames are clocked byte by byte from the SPI interrupt. Don't use
+        SPI.usingInterrupt with them.
+        */
+
+        /*
+        writes TORQUE (0-255), the shadow follows
+        */
+        void isrTorque(unsigned char value);
+
+        /*
+        writes ENBL, keeping ISGAIN and DTIME from the shadow. A CTRL write
+        under way in loop() can turn the bridge back on, stop with isrTrip.
+        returns false and sends nothing when turning on while tripped
+        */
+        bool isrBridge(bool on);
+
+        /*
+        emergency stop: turns the bridge off and latches it off. Until
+        clearTrip every frame writing CTRL, from setters, batches, wake,
+        drvBus or drvAsync, goes out with ENBL cleared.
+        */
+        void isrTrip();
+
+        /*
+        reads STATUS, the shadow follows and a nonzero value flags a read
+        for the next serviceFaults (which does the reporting)
+        returns the 6 fault bits, -1 if the frame failed its sanity check
+        */
+        int isrStatus();
+
+        /*
+        releases the trip latch and re-reads CTRL, call from loop()
+        the bridge stays off until turned on again
+        */
+        void clearTrip();
+
+        bool tripped();
+
+    private:
+
+        // shares frames with other devices on the bus
+        friend class drvBus;
+        // completes frames from the SPI interrupt
+        friend class drvAsync;
+        // times the checked read path on its own
+        friend class drvBench;
+
+        // register journal
+        JournalEntry _journal[DRV_JOURNAL_SIZE];
+        unsigned char _journalNext;
+        unsigned char _journalLength;
+        bool _journalOn;
+        unsigned char _journalSource;
+        unsigned char _dumpSlot;   // next entry to send
+        unsigned char _dumpLeft;   // entries still to send
+
+        /*
+        records a register access, address has JOURNAL_READ set for reads
+        */
+        void journal(unsigned char address, unsigned int oldValue, unsigned int newValue, unsigned char source);
+
+        // power management
+        enum PowerState {
+            POWER_AWAKE,
+            POWER_ASLEEP,
+            POWER_WAKING
+        };
+
+        int _sleepPin;
+        PowerState _power;
+        unsigned long _wakeStarted;
+
+        /*
+        attributes the journal entries made during its lifetime to source
+        */
+        class JournalScope {
+            public:
+                JournalScope(drv& device, unsigned char source) : _device(device), _saved(device._journalSource) {
+                    device._journalSource = source;
+                }
+                ~JournalScope() {
+                    _device._journalSource = _saved;
+                }
+            private:
+                drv& _device;
+                unsigned char _saved;
+        };
+
+        bool _shadowValid;
+        VerifyPolicy _verifyPolicy;
+        unsigned int _verifyEvery;
+        unsigned int _writesSinceVerify;
+        int _verifyPin;  // nFAULT for VERIFY_ON_FAULT
+        int _faultPin;   // nFAULT for the fault monitor
+
+        // fault monitor
+        volatile bool _faultPending;
+        bool _faultInterrupt;
+        unsigned long _faultReadAt; // micros of the monitor's last STATUS read
+        FaultCallback _faultCallback;
+        unsigned char _faultAutoClear;
+
+        /*
+        records a STATUS value in the fault state, reports and clears faults
+        */
+        void updateFaults(unsigned char status);
+
+        SPISettings _settings;
+        unsigned long _clock;
+
+        // queued batch frames, results of reads replace the packet
+        unsigned int _batchFrames[BATCH_SIZE];
+        int _batchLength;
+
+        // torque streaming state
+        bool _streaming;
+        unsigned int _streamFrame;
+        unsigned int _streamVerifyEvery;
+        unsigned long _streamVerifiedAt;
+
+#if defined(__AVR__)
+        // SCS port and bit, so hot paths can skip digitalWrite
+        volatile uint8_t* _scsPort;
+        uint8_t _scsMask;
+#endif
+
+        /*
+        drives SCS (active high)
+        */
+        void select(bool selected);
+
+        /*
+        clocks one 16 bit frame out inside an open transaction, framing it
+        with SCS, interrupts masked
+        */
+        unsigned int transfer(unsigned int packet);
+
+        // set by isrTrip, cleared by clearTrip
+        volatile bool _tripped;
+
+        /*
+        clears ENBL in a CTRL write packet while tripped, call with
+        interrupts masked and send the result right away
+        */
+        unsigned int gate(unsigned int packet);
+
+        /*
+        updates a shadow register with interrupts masked, clearing ENBL in
+        CTRL while tripped
+        */
+        void store(unsigned int address, unsigned int value);
+
+        /*
+        one frame in its own SPI settings, for the isr calls
+        */
+        unsigned int isrFrame(unsigned int packet);
+
+        // SPI reliability state
+        unsigned char _retries;
+        unsigned int _backoff;
+        unsigned int _readbackEvery;
+        unsigned int _writesSinceReadback;
+        unsigned char _failLimit;
+        unsigned char _failRun;    // failed transfers in a row
+        bool _busFailed;
+        bool _busProbe;            // autoTuneClock is provoking errors on purpose
+        BusFailureCallback _busFailureCallback;
+
+        /*
+        sends one frame in its own transaction, counted in timing.single*
+        */
+        unsigned int singleFrame(unsigned int packet);
+
+        /*
+        sends a read frame for reg, again up to _retries times while it
+        fails frameSane, and counts the outcome in busResult
+        held: inside a transaction already open (transfer), otherwise one
+            of its own (singleFrame)
+        sane: receives whether the frame returned passed
+        returns the last frame received
+        */
+        unsigned int checkedRead(unsigned int reg, bool held, bool& sane);
+
+        /*
+        true if a read frame from address passes the sanity checks
+        */
+        bool frameSane(unsigned int address, unsigned int frame);
+
+        /*
+        counts a transfer that passed or failed every attempt
+        */
+        void busResult(bool ok);
+
+        /*
+        true if the verify policy wants the last writes read back
+        */
+        bool verifyDue();
+
+        /*
+        writes the registers whose image differs from reference in one batch
+        returns the number written, -1 if a readback disagreed
+        */
+        int writeImages(const unsigned int images[], const unsigned int reference[]);
+
+        /*
+        writes value to address and applies the verify policy
+        returns false only if a readback (sampled or verify) disagreed with value
+        */
+        bool commit(unsigned int address, unsigned int value);
+
+        /*
+        read-modify-write of the bits under mask, through the shadow
+        */
+        bool writeField(unsigned int address, unsigned int mask, unsigned int bits);
         
 };
 
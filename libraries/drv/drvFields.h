@@ -0,0 +1,301 @@
+/*
+    drvFields.h - DRV8704 register field descriptors
+
+    Created by REV for SEM.
+
+    Every field drv can set is described once, at compile time, by the
+    register it lives in, its position and how setter values map to the
+    bits written. drv's setters and getters (and drv::set<Field>/get<Field>)
+    are generated from these, so encoding and decoding can't drift apart.
+
+    Usage:
+    sailboat.set<drvFields::ISGAIN>(10);
+    int gain = sailboat.get<drvFields::ISGAIN>();
+
+    Discrete fields also have a typed setting (see TYPED SETTINGS below)
+    whose values are the field codes, so they need no lookup at all:
+    sailboat.setISGain(ISGain::V10);
+    ISGain gain = sailboat.get<drvFields::ISGAIN, ISGain>();
+
+*/
+#ifndef drvFields_h
+#define drvFields_h
+
+#include <Arduino.h>
+
+namespace drvFields {
+
+    // field ids, used to name fields in log records
+    enum FieldId {
+        FIELD_ENBL,
+        FIELD_ISGAIN,
+        FIELD_DTIME,
+        FIELD_TORQUE,
+        FIELD_TOFF,
+        FIELD_PWMMODE,
+        FIELD_TBLANK,
+        FIELD_TDECAY,
+        FIELD_DECMOD,
+        FIELD_OCPTH,
+        FIELD_OCPDEG,
+        FIELD_TDRIVEN,
+        FIELD_TDRIVEP,
+        FIELD_IDRIVEN,
+        FIELD_IDRIVEP,
+        FIELD_COUNT
+    };
+
+    // what caused a register access, for the register journal. Setters
+    // are identified by their FieldId, everything else by one of these.
+    enum Source {
+        SOURCE_API = FIELD_COUNT, // read(), write() or runBatch() called directly
+        SOURCE_SYNC,              // shadow seeded from the chip
+        SOURCE_VERIFY,            // readback of a write
+        SOURCE_PROFILE,           // applyProfile
+        SOURCE_FAULT,             // fault handling (STATUS)
+        SOURCE_STREAM,            // torque stream check
+        SOURCE_DIAG,              // regDiagnostic
+        SOURCE_CLOCK,             // autoTuneClock
+        SOURCE_BUS,               // drvBus
+        SOURCE_ASYNC,             // drvAsync
+        SOURCE_WAKE,              // restore after sleep
+        SOURCE_COUNT
+    };
+}
+
+/*
+field whose setter value is written as is
+Id: FieldId, Reg: register address, Shift: lowest bit, Width: number of bits
+*/
+template <unsigned char Id, unsigned int Reg, unsigned int Shift, unsigned int Width>
+struct drvField {
+    static const unsigned char id = Id;
+    static const unsigned int reg = Reg;
+    static const unsigned int shift = Shift;
+    static const unsigned int mask = ((1u << Width) - 1) << Shift;
+
+    /*
+    returns the field code for value, -1 if value can't be set
+    */
+    static constexpr int encode(long value) {
+        return (value >= 0 && value < (1L << Width)) ? (int)value : -1;
+    }
+
+    /*
+    returns the setter value for a field code
+    */
+    static constexpr int decode(unsigned int code) {
+        return code;
+    }
+};
+
+/*
+field with four settings, V0-V3 are written as codes C0-C3
+*/
+template <unsigned char Id, unsigned int Reg, unsigned int Shift, unsigned int Width,
+          int V0, int V1, int V2, int V3,
+          unsigned int C0 = 0, unsigned int C1 = 1, unsigned int C2 = 2, unsigned int C3 = 3>
+struct drvTableField {
+    static const unsigned char id = Id;
+    static const unsigned int reg = Reg;
+    static const unsigned int shift = Shift;
+    static const unsigned int mask = ((1u << Width) - 1) << Shift;
+
+    static constexpr int encode(long value) {
+        return value == V0 ? C0 :
+               value == V1 ? C1 :
+               value == V2 ? C2 :
+               value == V3 ? C3 : -1;
+    }
+
+    /*
+    returns 0 for codes that aren't in the table
+    */
+    static constexpr int decode(unsigned int code) {
+        return code == C0 ? V0 :
+               code == C1 ? V1 :
+               code == C2 ? V2 :
+               code == C3 ? V3 : 0;
+    }
+};
+
+namespace drvFields {
+
+    // CTRL (0x0)
+    typedef drvField<FIELD_ENBL, 0x0, 0, 1> ENBL;                                           // 0 off, 1 on
+    typedef drvTableField<FIELD_ISGAIN, 0x0, 8, 2, 5, 10, 20, 40> ISGAIN;                   // V/V
+    typedef drvTableField<FIELD_DTIME, 0x0, 10, 2, 410, 460, 670, 880> DTIME;               // ns
+
+    // TORQUE (0x1)
+    typedef drvField<FIELD_TORQUE, 0x1, 0, 8> TORQUE;
+
+    // OFF (0x2)
+    typedef drvField<FIELD_TOFF, 0x2, 0, 8> TOFF;                                           // 525 ns steps
+    typedef drvField<FIELD_PWMMODE, 0x2, 8, 1> PWMMODE;                                     // should always be 1
+
+    // BLANK (0x3)
+    typedef drvField<FIELD_TBLANK, 0x3, 0, 8> TBLANK;                                       // 21 ns steps
+
+    // DECAY (0x4)
+    typedef drvField<FIELD_TDECAY, 0x4, 0, 8> TDECAY;                                       // 525 ns steps
+    // slow, fast, mixed, auto
+    typedef drvTableField<FIELD_DECMOD, 0x4, 8, 3, 0, 1, 2, 3, 0x0, 0x2, 0x3, 0x5> DECMOD;
+
+    // DRIVE (0x6)
+    typedef drvTableField<FIELD_OCPTH, 0x6, 0, 2, 250, 500, 750, 1000> OCPTH;               // mV
+    typedef drvTableField<FIELD_OCPDEG, 0x6, 2, 2, 1050, 2100, 4200, 8400> OCPDEG;          // ns
+    typedef drvTableField<FIELD_TDRIVEN, 0x6, 4, 2, 263, 525, 1050, 2100> TDRIVEN;          // ns
+    typedef drvTableField<FIELD_TDRIVEP, 0x6, 6, 2, 263, 525, 1050, 2100> TDRIVEP;          // ns
+    typedef drvTableField<FIELD_IDRIVEN, 0x6, 8, 2, 100, 200, 300, 400> IDRIVEN;            // mA
+    typedef drvTableField<FIELD_IDRIVEP, 0x6, 10, 2, 50, 100, 150, 200> IDRIVEP;            // mA
+
+    // where each field lives, indexed by FieldId (in flash, see fieldReg/fieldMask)
+    struct FieldInfo {
+        unsigned char reg;
+        unsigned int mask;
+    };
+
+    const FieldInfo fieldInfo[FIELD_COUNT] PROGMEM = {
+        {ENBL::reg, ENBL::mask}, {ISGAIN::reg, ISGAIN::mask}, {DTIME::reg, DTIME::mask},
+        {TORQUE::reg, TORQUE::mask}, {TOFF::reg, TOFF::mask}, {PWMMODE::reg, PWMMODE::mask},
+        {TBLANK::reg, TBLANK::mask}, {TDECAY::reg, TDECAY::mask}, {DECMOD::reg, DECMOD::mask},
+        {OCPTH::reg, OCPTH::mask}, {OCPDEG::reg, OCPDEG::mask}, {TDRIVEN::reg, TDRIVEN::mask},
+        {TDRIVEP::reg, TDRIVEP::mask}, {IDRIVEN::reg, IDRIVEN::mask}, {IDRIVEP::reg, IDRIVEP::mask}
+    };
+
+    // DECMOD settings
+    const int DECAY_SLOW = 0;
+    const int DECAY_FAST = 1;
+    const int DECAY_MIXED = 2;
+    const int DECAY_AUTO = 3;
+
+    inline unsigned char fieldReg(int field) {
+        return pgm_read_byte(&fieldInfo[field].reg);
+    }
+
+    inline unsigned int fieldMask(int field) {
+        return pgm_read_word(&fieldInfo[field].mask);
+    }
+
+    // names, for printing. Names and tables are in flash, read the
+    // pointers with pgm_read_ptr and print them as __FlashStringHelper
+    const char nameCTRL[] PROGMEM = "CTRL";
+    const char nameTORQUE[] PROGMEM = "TORQUE";
+    const char nameOFF[] PROGMEM = "OFF";
+    const char nameBLANK[] PROGMEM = "BLANK";
+    const char nameDECAY[] PROGMEM = "DECAY";
+    const char nameRESERVED[] PROGMEM = "RESERVED";
+    const char nameDRIVE[] PROGMEM = "DRIVE";
+    const char nameSTATUS[] PROGMEM = "STATUS";
+
+    const char* const registerNames[8] PROGMEM = {
+        nameCTRL, nameTORQUE, nameOFF, nameBLANK, nameDECAY, nameRESERVED, nameDRIVE, nameSTATUS
+    };
+
+    const char nameENBL[] PROGMEM = "ENBL";
+    const char nameISGAIN[] PROGMEM = "ISGAIN";
+    const char nameDTIME[] PROGMEM = "DTIME";
+    const char nameTOFF[] PROGMEM = "TOFF";
+    const char namePWMMODE[] PROGMEM = "PWMMODE";
+    const char nameTBLANK[] PROGMEM = "TBLANK";
+    const char nameTDECAY[] PROGMEM = "TDECAY";
+    const char nameDECMOD[] PROGMEM = "DECMOD";
+    const char nameOCPTH[] PROGMEM = "OCPTH";
+    const char nameOCPDEG[] PROGMEM = "OCPDEG";
+    const char nameTDRIVEN[] PROGMEM = "TDRIVEN";
+    const char nameTDRIVEP[] PROGMEM = "TDRIVEP";
+    const char nameIDRIVEN[] PROGMEM = "IDRIVEN";
+    const char nameIDRIVEP[] PROGMEM = "IDRIVEP";
+
+    const char* const fieldNames[FIELD_COUNT] PROGMEM = {
+        nameENBL, nameISGAIN, nameDTIME, nameTORQUE, nameTOFF, namePWMMODE, nameTBLANK, nameTDECAY,
+        nameDECMOD, nameOCPTH, nameOCPDEG, nameTDRIVEN, nameTDRIVEP, nameIDRIVEN, nameIDRIVEP
+    };
+
+    const char nameOff[] PROGMEM = "off";
+    const char nameOn[] PROGMEM = "on";
+    const char* const enblNames[] PROGMEM = {nameOff, nameOn};
+
+    const char nameSlow[] PROGMEM = "slow";
+    const char nameFast[] PROGMEM = "fast";
+    const char nameMixed[] PROGMEM = "mixed";
+    const char nameAuto[] PROGMEM = "auto";
+    const char* const decmodNames[] PROGMEM = {nameSlow, nameFast, nameMixed, nameAuto};
+
+    const char nameAPI[] PROGMEM = "api";
+    const char nameSync[] PROGMEM = "sync";
+    const char nameVerify[] PROGMEM = "verify";
+    const char nameProfile[] PROGMEM = "profile";
+    const char nameFault[] PROGMEM = "fault";
+    const char nameStream[] PROGMEM = "stream";
+    const char nameDiag[] PROGMEM = "diagnostic";
+    const char nameClock[] PROGMEM = "clock";
+    const char nameBus[] PROGMEM = "bus";
+    const char nameAsync[] PROGMEM = "async";
+    const char nameWake[] PROGMEM = "wake";
+
+    // names of every Source, setters by their field name
+    const char* const sourceNames[SOURCE_COUNT] PROGMEM = {
+        nameENBL, nameISGAIN, nameDTIME, nameTORQUE, nameTOFF, namePWMMODE, nameTBLANK, nameTDECAY,
+        nameDECMOD, nameOCPTH, nameOCPDEG, nameTDRIVEN, nameTDRIVEP, nameIDRIVEN, nameIDRIVEP,
+        nameAPI, nameSync, nameVerify, nameProfile, nameFault, nameStream, nameDiag, nameClock,
+        nameBus, nameAsync, nameWake
+    };
+
+    // names of each field's settings, NULL where the setting is a number
+    const char* const* const valueNames[FIELD_COUNT] PROGMEM = {
+        enblNames, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+        decmodNames, NULL, NULL, NULL, NULL, NULL, NULL
+    };
+
+    // length of each valueNames table, 0 where it is NULL
+    const unsigned char valueNameCounts[FIELD_COUNT] PROGMEM = {
+        sizeof(enblNames) / sizeof(enblNames[0]), 0, 0, 0, 0, 0, 0, 0,
+        sizeof(decmodNames) / sizeof(decmodNames[0]), 0, 0, 0, 0, 0, 0
+    };
+}
+
+// *** TYPED SETTINGS ***
+// one enum per discrete field, each value is the code written to the field
+
+/*
+drvTypedSetting<Setting, T>::type is T only for enum settings, so a plain
+number never picks a typed overload (no <type_traits> on AVR)
+*/
+template <bool IsEnum, class T>
+struct drvTypedSettingIf {};
+
+template <class T>
+struct drvTypedSettingIf<true, T> {
+    typedef T type;
+};
+
+template <class Setting, class T>
+struct drvTypedSetting : drvTypedSettingIf<__is_enum(Setting), T> {};
+
+enum class Bridge : unsigned char { Off = 0, On = 1 };                     // ENBL
+enum class Decay : unsigned char { Slow = 0x0, Fast = 0x2, Mixed = 0x3, Auto = 0x5 }; // DECMOD
+enum class ISGain : unsigned char { V5, V10, V20, V40 };                   // ISGAIN, V/V
+enum class DeadTime : unsigned char { Ns410, Ns460, Ns670, Ns880 };        // DTIME
+enum class OCPThreshold : unsigned char { Mv250, Mv500, Mv750, Mv1000 };   // OCPTH
+enum class OCPDeglitch : unsigned char { Us1_05, Us2_1, Us4_2, Us8_4 };    // OCPDEG
+enum class GateDriveTime : unsigned char { Ns263, Ns525, Ns1050, Ns2100 }; // TDRIVEN, TDRIVEP
+enum class SinkCurrent : unsigned char { Ma100, Ma200, Ma300, Ma400 };     // IDRIVEN
+enum class SourceCurrent : unsigned char { Ma50, Ma100, Ma150, Ma200 };    // IDRIVEP
+
+/*
+names of the string valued settings, for logging and printing only
+*/
+inline const __FlashStringHelper* settingName(Bridge value) {
+    return (const __FlashStringHelper*)pgm_read_ptr(&drvFields::enblNames[(unsigned char)value & 1]);
+}
+
+inline const __FlashStringHelper* settingName(Decay value) {
+    unsigned int code = (unsigned char)value;
+    if (drvFields::DECMOD::encode(drvFields::DECMOD::decode(code)) != (int)code) {
+        return F("none"); // reserved code
+    }
+    return (const __FlashStringHelper*)pgm_read_ptr(&drvFields::decmodNames[drvFields::DECMOD::decode(code)]);
+}
+
+#endif
@@ -0,0 +1,115 @@
+/*
+    drvProfile.h - complete DRV8704 configurations in engineering units
+
+    Created by REV for SEM.
+
+    A DrvProfile holds every setting of CTRL, TORQUE, OFF, BLANK, DECAY and
+    DRIVE, in the units the setters take (see drvFields.h). Declared
+    constexpr, a profile is checked and turned into register images at
+    compile time, and drv::applyProfile writes only the registers whose
+    shadow values differ, in one batch.
+
+    Usage:
+    constexpr DrvProfile boat = {
+        false, 10, 410,         // enable, isGain (V/V), dTime (ns)
+        0x70,                   // torque
+        48, 128,                // tOff (525 ns steps), tBlank (21 ns steps)
+        16, drvFields::DECAY_SLOW, // tDecay (525 ns steps), decMode
+        500, 2100,              // ocpThresh (mV), ocpDeglitch (ns)
+        1050, 1050, 400, 200    // tDriveN, tDriveP (ns), iDriveN, iDriveP (mA)
+    };
+    static_assert(drvProfileValid(boat), "boat profile out of range");
+    sailboat.applyProfile(boat);
+
+    Profiles kept in flash (PROGMEM) go through applyProfile_P, profiles
+    in EEPROM through saveProfile/loadProfile.
+
+*/
+#ifndef drvProfile_h
+#define drvProfile_h
+
+#include "drvFields.h"
+
+struct DrvProfile {
+    // CTRL
+    bool enable;
+    int isGain;
+    int dTime;
+
+    // TORQUE
+    unsigned char torque;
+
+    // OFF (PWMMODE is always 1)
+    unsigned char tOff;
+
+    // BLANK
+    unsigned char tBlank;
+
+    // DECAY
+    unsigned char tDecay;
+    unsigned char decMode;
+
+    // DRIVE
+    int ocpThresh;
+    int ocpDeglitch;
+    int tDriveN;
+    int tDriveP;
+    int iDriveN;
+    int iDriveP;
+};
+
+/*
+bits of a field's setting in its register, 0 if value can't be set
+*/
+template <class Field>
+constexpr unsigned int drvFieldBits(long value) {
+    return Field::encode(value) < 0 ? 0 : ((unsigned int)Field::encode(value) << Field::shift) & Field::mask;
+}
+
+/*
+true if every setting of the profile can be written
+*/
+constexpr bool drvProfileValid(const DrvProfile& p) {
+    return drvFields::ISGAIN::encode(p.isGain) >= 0
+        && drvFields::DTIME::encode(p.dTime) >= 0
+        && drvFields::DECMOD::encode(p.decMode) >= 0
+        && drvFields::OCPTH::encode(p.ocpThresh) >= 0
+        && drvFields::OCPDEG::encode(p.ocpDeglitch) >= 0
+        && drvFields::TDRIVEN::encode(p.tDriveN) >= 0
+        && drvFields::TDRIVEP::encode(p.tDriveP) >= 0
+        && drvFields::IDRIVEN::encode(p.iDriveN) >= 0
+        && drvFields::IDRIVEP::encode(p.iDriveP) >= 0;
+}
+
+/*
+12 bit image of register address for the profile (0 for RESERVED and STATUS)
+*/
+constexpr unsigned int drvProfileImage(const DrvProfile& p, unsigned int address) {
+    return address == 0x0 ? drvFieldBits<drvFields::DTIME>(p.dTime)
+                          | drvFieldBits<drvFields::ISGAIN>(p.isGain)
+                          | drvFieldBits<drvFields::ENBL>(p.enable) :
+           address == 0x1 ? drvFieldBits<drvFields::TORQUE>(p.torque) :
+           address == 0x2 ? drvFieldBits<drvFields::PWMMODE>(1)
+                          | drvFieldBits<drvFields::TOFF>(p.tOff) :
+           address == 0x3 ? drvFieldBits<drvFields::TBLANK>(p.tBlank) :
+           address == 0x4 ? drvFieldBits<drvFields::DECMOD>(p.decMode)
+                          | drvFieldBits<drvFields::TDECAY>(p.tDecay) :
+           address == 0x6 ? drvFieldBits<drvFields::IDRIVEP>(p.iDriveP)
+                          | drvFieldBits<drvFields::IDRIVEN>(p.iDriveN)
+                          | drvFieldBits<drvFields::TDRIVEP>(p.tDriveP)
+                          | drvFieldBits<drvFields::TDRIVEN>(p.tDriveN)
+                          | drvFieldBits<drvFields::OCPDEG>(p.ocpDeglitch)
+                          | drvFieldBits<drvFields::OCPTH>(p.ocpThresh) : 0;
+}
+
+// the configuration drv starts from (initRegs)
+constexpr DrvProfile DRV_DEFAULT_PROFILE = {
+    true, 40, 410,
+    255,
+    48, 128,
+    16, drvFields::DECAY_SLOW,
+    500, 2100,
+    1050, 1050, 400, 200
+};
+
+#endif
@@ -0,0 +1,205 @@
+/*
+    drvAsync.cpp - interrupt driven, non-blocking register access for a drv
+
+    Created by REV for SEM.
+
+    ** see drvAsync.h for full doc **
+
+*/
+#include <SPI.h>
+#include <Arduino.h>
+#include "drv.h"
+#include "drvAsync.h"
+
+// engine owning the SPI interrupt
+static drvAsync* activeEngine = NULL;
+
+/*
+BACKENDS
+*/
+#if defined(__AVR__)
+
+#include <avr/interrupt.h>
+
+ISR(SPI_STC_vect) {
+  if (activeEngine) {
+    activeEngine->onByteComplete(SPDR);
+  }
+}
+
+static void attachBackend() {}
+
+static void enableBackend(bool on) {
+  if (on) {
+    SPCR |= _BV(SPIE);
+  } else {
+    SPCR &= ~_BV(SPIE);
+  }
+}
+
+static void startByte(unsigned char data) {
+  SPDR = data;
+}
+
+#elif defined(DRV_HOST_SIM)
+
+#include "hostsim.h"
+
+static void onHostInterrupt(uint8_t received) {
+  if (activeEngine) {
+    activeEngine->onByteComplete(received);
+  }
+}
+
+static void attachBackend() {
+  hostsim::setSpiInterrupt(onHostInterrupt);
+}
+
+static void enableBackend(bool) {}
+
+static void startByte(unsigned char data) {
+  hostsim::startByte(data);
+}
+
+#else
+
+// no interrupt backend, every byte completes as soon as it is started
+static void attachBackend() {}
+
+static void enableBackend(bool) {}
+
+static void startByte(unsigned char data) {
+  unsigned char received = SPI.transfer(data);
+  if (activeEngine) {
+    activeEngine->onByteComplete(received);
+  }
+}
+
+#endif
+
+/*
+ENGINE
+*/
+drvAsync::drvAsync(drv& device) : _device(device) {
+  _submitted = 0;
+  _completed = 0;
+  _state = IDLE;
+  _receivedHigh = 0;
+}
+
+void drvAsync::begin() {
+  activeEngine = this;
+  attachBackend();
+}
+
+bool drvAsync::submitRead(unsigned int address, Callback callback, void* context, unsigned int* ticket) {
+  return submit((address << 12) | 0x8000, callback, context, ticket); // MSB set to read
+}
+
+bool drvAsync::submitWrite(unsigned int address, unsigned int value, Callback callback, void* context, unsigned int* ticket) {
+  return submit((address << 12) | (value & 0xFFF), callback, context, ticket); // MSB clear to write
+}
+
+bool drvAsync::submit(unsigned int packet, Callback callback, void* context, unsigned int* ticket) {
+  noInterrupts();
+  if ((unsigned int)(_submitted - _completed) >= QUEUE_SIZE) {
+    interrupts();
+    return false;
+  }
+
+  Request& request = _queue[_submitted & (QUEUE_SIZE - 1)];
+  request.packet = packet;
+  request.callback = callback;
+  request.context = context;
+  if (ticket) {
+    *ticket = _submitted;
+  }
+  _submitted++;
+
+  bool idle = (_state == IDLE);
+  if (idle) {
+    // claim the bus, the interrupt handler keeps it until the queue drains
+    _state = HIGH_BYTE;
+  }
+  interrupts();
+
+  if (idle) {
+    SPI.beginTransaction(_device.settings());
+    enableBackend(true);
+    startFrame();
+  }
+  return true;
+}
+
+bool drvAsync::done(unsigned int ticket) {
+  noInterrupts();
+  bool complete = (int)(_completed - ticket) > 0;
+  interrupts();
+  return complete;
+}
+
+unsigned int drvAsync::result(unsigned int ticket) {
+  return _queue[ticket & (QUEUE_SIZE - 1)].result;
+}
+
+bool drvAsync::busy() {
+  return _state != IDLE;
+}
+
+unsigned char drvAsync::pending() {
+  noInterrupts();
+  unsigned char count = _submitted - _completed;
+  interrupts();
+  return count;
+}
+
+void drvAsync::startFrame() {
+  Request& request = _queue[_completed & (QUEUE_SIZE - 1)];
+  request.packet = _device.gate(request.packet);
+  digitalWrite(_device._SCS, HIGH); // SCS is active high
+  _state = HIGH_BYTE;
+  startByte(request.packet >> 8);
+}
+
+void drvAsync::onByteComplete(unsigned char received) {
+  if (_state == HIGH_BYTE) {
+    _receivedHigh = received;
+    _state = LOW_BYTE;
+    startByte(_queue[_completed & (QUEUE_SIZE - 1)].packet & 0xFF);
+  } else if (_state == LOW_BYTE) {
+    finishFrame(((unsigned int)_receivedHigh << 8) | received);
+  }
+}
+
+void drvAsync::finishFrame(unsigned int received) {
+  Request& request = _queue[_completed & (QUEUE_SIZE - 1)];
+  unsigned int reg = (request.packet >> 12) & 0x7;
+
+  digitalWrite(_device._SCS, LOW);
+
+  bool read = request.packet & 0x8000;
+  if (read && !_device.frameSane(reg, received)) {
+    // same check as drv::read, a bad frame never reaches the shadow
+    _device.regErrors[reg]++;
+    request.result = BAD_FRAME;
+  } else {
+    request.result = read ? received & 0xFFF : request.packet & 0xFFF;
+    _device.journal(reg | (read ? drv::JOURNAL_READ : 0),
+                    _device.currentRegisterValues[reg], request.result, drvFields::SOURCE_ASYNC);
+    _device.store(reg, request.result);
+  }
+  _device.frameCount++;
+  _completed++;
+
+  if (request.callback) {
+    request.callback(reg, request.result, request.context);
+  }
+
+  if (_completed != _submitted) {
+    startFrame();
+  } else {
+    _state = IDLE;
+    enableBackend(false);
+    SPI.endTransaction();
+  }
+}
@@ -0,0 +1,140 @@
+/*
+    drvAsync.h - interrupt driven, non-blocking register access for a drv
+
+    Created by REV for SEM.
+
+    Requests are queued and clocked out byte by byte from the SPI transfer
+    complete interrupt, so the caller never waits on the bus. Completed
+    requests update the drv's shadow registers. A read whose frame fails
+    drv's sanity check (MISO stuck high, reserved bits set) leaves the
+    shadow alone, counts in drv::regErrors and completes with BAD_FRAME.
+
+    Usage:
+    drvAsync engine(sailboat);
+    engine.begin();
+    unsigned int ticket;
+    engine.submitWrite(sailboat.TORQUE, 0x070, NULL, NULL, &ticket);
+    ...
+    if (engine.done(ticket)) { ... }
+
+    While requests are in flight the SPI peripheral belongs to the engine,
+    don't call the blocking drv functions until busy() returns false.
+
+    Backends:
+    AVR - SPI_STC_vect interrupt
+    host (DRV_HOST_SIM) - hostsim's simulated peripheral, run with hostsim::run()
+    others - no interrupt backend yet, requests complete inside submit
+
+    Dependencies:
+
+    drv Library.
+
+*/
+#ifndef drvAsync_h
+#define drvAsync_h
+
+#include <Arduino.h>
+#include "drv.h"
+
+class drvAsync {
+    public:
+
+        /*
+        called from interrupt context when a request completes
+        value: 12 bit register value (read back for reads, written for writes),
+            BAD_FRAME for a read that failed its check
+        */
+        typedef void (*Callback)(unsigned int address, unsigned int value, void* context);
+
+        // must be a power of two
+        static const unsigned char QUEUE_SIZE = 8;
+
+        // result of a read whose frame failed its check, never a 12 bit value
+        static const unsigned int BAD_FRAME = 0xFFFF;
+
+        drvAsync(drv& device);
+
+        /*
+        hooks the engine up to the SPI interrupt
+        */
+        void begin();
+
+        /*
+        queues a register read
+        callback: called when the frame completes (can be NULL)
+        ticket: receives the request's ticket (can be NULL)
+        returns false if the queue is full
+        */
+        bool submitRead(unsigned int address, Callback callback = NULL, void* context = NULL, unsigned int* ticket = NULL);
+
+        /*
+        queues a register write, see submitRead
+        */
+        bool submitWrite(unsigned int address, unsigned int value, Callback callback = NULL, void* context = NULL, unsigned int* ticket = NULL);
+
+        /*
+        true once the request with this ticket has completed
+        */
+        bool done(unsigned int ticket);
+
+        /*
+        12 bit result of a completed request, or BAD_FRAME
+        valid until QUEUE_SIZE more requests have been submitted
+        */
+        unsigned int result(unsigned int ticket);
+
+        /*
+        true while requests are queued or in flight
+        */
+        bool busy();
+
+        /*
+        number of requests waiting or in flight
+        */
+        unsigned char pending();
+
+        /*
+        feeds one received byte to the state machine (called by the interrupt backend)
+        */
+        void onByteComplete(unsigned char received);
+
+    private:
+
+        enum State {
+            IDLE,
+            HIGH_BYTE,
+            LOW_BYTE
+        };
+
+        struct Request {
+            unsigned int packet;
+            unsigned int result;
+            Callback callback;
+            void* context;
+        };
+
+        drv& _device;
+
+        Request _queue[QUEUE_SIZE];
+
+        // tickets, the request at _completed is the one in flight
+        volatile unsigned int _submitted;
+        volatile unsigned int _completed;
+
+        volatile unsigned char _state;
+        unsigned char _receivedHigh;
+
+        bool submit(unsigned int packet, Callback callback, void* context, unsigned int* ticket);
+
+        /*
+        selects the chip and starts clocking out the request at _completed
+        */
+        void startFrame();
+
+        /*
+        finishes the request in flight, starts the next one if there is one
+        */
+        void finishFrame(unsigned int received);
+};
+
+#endif
@@ -0,0 +1,225 @@
+/*
+    drvBench.cpp - microbenchmarks for the drv public API
+
+    Created by REV for SEM.
+
+    ** see drvBench.h for full doc **
+
+*/
+#include <Arduino.h>
+#include "drv.h"
+#include "Logger.h"
+#include "drvBench.h"
+
+/*
+BENCHMARKED CALLS
+values cycle through valid settings, the bridge stays off
+*/
+void benchSetTorque(drv& d, unsigned int i) { d.setTorque(i & 0xFF); }
+void benchGetTorque(drv& d, unsigned int) { d.getTorque(); }
+void benchSetField(drv& d, unsigned int i) { d.set<drvFields::TORQUE>(i & 0xFF); }
+void benchSetISGain(drv& d, unsigned int i) { d.setISGain(i & 1 ? 10 : 40); }
+void benchGetISGain(drv& d, unsigned int) { d.getISGain(); }
+void benchSetDTime(drv& d, unsigned int i) { d.setDTime(i & 1 ? 460 : 410); }
+void benchGetDTime(drv& d, unsigned int) { d.getDTime(); }
+void benchSetHbridge(drv& d, unsigned int) { d.setHbridge(Bridge::Off); }
+void benchGetHbridge(drv& d, unsigned int) { d.getHbridge(); }
+void benchSetTOff(drv& d, unsigned int i) { d.setTOff(i & 0xFF); }
+void benchSetTBlank(drv& d, unsigned int i) { d.setTBlank(i & 0xFF); }
+void benchSetTDecay(drv& d, unsigned int i) { d.setTDecay(i & 0xFF); }
+void benchSetDecMode(drv& d, unsigned int i) { d.setDecMode(i & 1 ? Decay::Mixed : Decay::Slow); }
+void benchGetDecMode(drv& d, unsigned int) { d.getDecMode(); }
+void benchSetOCPThresh(drv& d, unsigned int i) { d.setOCPThresh(i & 1 ? 250 : 500); }
+void benchSetOCPDeglitch(drv& d, unsigned int i) { d.setOCPDeglitchTime(i & 1 ? 1.05 : 2.1); }
+void benchGetOCPDeglitch(drv& d, unsigned int) { d.getOCPDeglitchTime(); }
+void benchSetTDriveN(drv& d, unsigned int i) { d.setTDriveN(i & 1 ? 525 : 1050); }
+void benchSetTDriveP(drv& d, unsigned int i) { d.setTDriveP(i & 1 ? 525 : 1050); }
+void benchSetIDriveN(drv& d, unsigned int i) { d.setIDriveN(i & 1 ? 300 : 400); }
+void benchSetIDriveP(drv& d, unsigned int i) { d.setIDriveP(i & 1 ? 150 : 200); }
+void benchRead(drv& d, unsigned int) { d.read(d.TORQUE); }
+void benchWrite(drv& d, unsigned int i) { d.write(d.TORQUE, i & 0xFF); }
+void benchGetCurrentRegisters(drv& d, unsigned int) { d.getCurrentRegisters(); }
+void benchRegDiagnostic(drv& d, unsigned int) { d.regDiagnostic(d.initRegs); }
+void benchGetFault(drv& d, unsigned int) { d.getFault(); }
+void benchServiceFaults(drv& d, unsigned int) { d.serviceFaults(); }
+
+void benchBatch(drv& d, unsigned int i) {
+  d.beginBatch();
+  d.queueWrite(d.TORQUE, i & 0xFF);
+  d.queueWrite(d.BLANK, 0x080);
+  d.queueRead(d.STATUS);
+  d.runBatch();
+}
+
+void benchStreamTorque(drv& d, unsigned int i) { d.streamTorque(i & 0xFF); }
+void benchIsrTorque(drv& d, unsigned int i) { d.isrTorque(i & 0xFF); }
+void benchIsrBridge(drv& d, unsigned int) { d.isrBridge(false); }
+void benchIsrStatus(drv& d, unsigned int) { d.isrStatus(); }
+
+void benchIsrTrip(drv& d, unsigned int) {
+  d.isrTrip();
+  d.clearTrip();
+}
+
+void benchApplyProfile(drv& d, unsigned int i) {
+  // one register differs each time, the bridge stays off
+  DrvProfile profile = DRV_DEFAULT_PROFILE;
+  profile.enable = false;
+  profile.torque = i & 1 ? 0x40 : 0x80;
+  d.applyProfile(profile);
+}
+
+struct BenchCall {
+  const char* name;
+  drvBench::Call call;
+};
+
+const BenchCall benchCalls[] = {
+  {"setTorque", benchSetTorque},
+  {"getTorque", benchGetTorque},
+  {"set<TORQUE>", benchSetField},
+  {"setISGain", benchSetISGain},
+  {"getISGain", benchGetISGain},
+  {"setDTime", benchSetDTime},
+  {"getDTime", benchGetDTime},
+  {"setHbridge", benchSetHbridge},
+  {"getHbridge", benchGetHbridge},
+  {"setTOff", benchSetTOff},
+  {"setTBlank", benchSetTBlank},
+  {"setTDecay", benchSetTDecay},
+  {"setDecMode", benchSetDecMode},
+  {"getDecMode", benchGetDecMode},
+  {"setOCPThresh", benchSetOCPThresh},
+  {"setOCPDeglitchTime", benchSetOCPDeglitch},
+  {"getOCPDeglitchTime", benchGetOCPDeglitch},
+  {"setTDriveN", benchSetTDriveN},
+  {"setTDriveP", benchSetTDriveP},
+  {"setIDriveN", benchSetIDriveN},
+  {"setIDriveP", benchSetIDriveP},
+  {"read", benchRead},
+  {"write", benchWrite},
+  {"getCurrentRegisters", benchGetCurrentRegisters},
+  {"regDiagnostic", benchRegDiagnostic},
+  {"getFault", benchGetFault},
+  {"serviceFaults", benchServiceFaults},
+  {"runBatch(3)", benchBatch},
+  {"applyProfile", benchApplyProfile},
+  {"isrTorque", benchIsrTorque},
+  {"isrBridge", benchIsrBridge},
+  {"isrStatus", benchIsrStatus},
+  {"isrTrip+clearTrip", benchIsrTrip},
+};
+
+void drvBench::benchCheckedRead(drv& d, unsigned int) {
+  bool sane;
+  d.checkedRead(d.TORQUE, false, sane);
+}
+
+void drvBench::benchSleepWake(drv& d, unsigned int) {
+  d.sleep();
+  d.wake(true);
+}
+
+/*
+HARNESS
+*/
+drvBench::drvBench(drv& device, Logger& log) : _device(device), _log(log) {}
+
+void drvBench::printHeader() {
+  Serial.println(F("bench,mode,name,iterations,min_us,median_us,p99_us,frames,log_bytes"));
+}
+
+drvBench::Result drvBench::measure(const char* mode, const char* name, Call call, unsigned int iterations) {
+  Result result;
+  unsigned long frames = _device.frameCount;
+  unsigned long logBytes = _log.bytesLogged;
+
+  if (iterations > MAX_SAMPLES) {
+    iterations = MAX_SAMPLES;
+  }
+
+  for (unsigned int i = 0; i < iterations; i++) {
+    unsigned long start = micros();
+    call(_device, i);
+    _samples[i] = micros() - start;
+  }
+
+  result.name = name;
+  result.iterations = iterations;
+  result.frames = (_device.frameCount - frames) / iterations;
+  result.logBytes = (_log.bytesLogged - logBytes) / iterations;
+
+  // insertion sort, at most MAX_SAMPLES entries
+  for (unsigned int i = 1; i < iterations; i++) {
+    unsigned long sample = _samples[i];
+    unsigned int j = i;
+    while (j > 0 && _samples[j - 1] > sample) {
+      _samples[j] = _samples[j - 1];
+      j--;
+    }
+    _samples[j] = sample;
+  }
+
+  result.minMicros = _samples[0];
+  result.medianMicros = _samples[iterations / 2];
+  result.p99Micros = _samples[(iterations * 99) / 100];
+
+  print(mode, result);
+  return result;
+}
+
+void drvBench::print(const char* mode, const Result& result) {
+  Serial.print(F("bench,"));
+  Serial.print(mode);
+  Serial.print(',');
+  Serial.print(result.name);
+  Serial.print(',');
+  Serial.print(result.iterations);
+  Serial.print(',');
+  Serial.print(result.minMicros);
+  Serial.print(',');
+  Serial.print(result.medianMicros);
+  Serial.print(',');
+  Serial.print(result.p99Micros);
+  Serial.print(',');
+  Serial.print(result.frames);
+  Serial.print(',');
+  Serial.println(result.logBytes);
+}
+
+bool drvBench::run(const char* mode, unsigned int iterations) {
+  if (_device.get<drvFields::ENBL>()) {
+    _log.loge(F("bench: disable the bridge first"));
+    return false;
+  }
+
+  unsigned int saved[8];
+  for (int i = 0; i < 8; i++) {
+    saved[i] = _device.cached(i);
+  }
+
+  for (unsigned int i = 0; i < sizeof(benchCalls) / sizeof(benchCalls[0]); i++) {
+    measure(mode, benchCalls[i].name, benchCalls[i].call, iterations);
+  }
+
+  measure(mode, "checkedRead", benchCheckedRead, iterations);
+
+  _device.armTorqueStream();
+  measure(mode, "streamTorque", benchStreamTorque, iterations);
+  _device.disarmTorqueStream();
+
+  if (_device._sleepPin >= 0) {
+    measure(mode, "sleep+wake", benchSleepWake, iterations);
+  }
+
+  // put the configuration back in one transaction
+  _device.beginBatch();
+  for (int i = 0; i < 7; i++) {
+    if (i != 5) { // reserved register
+      _device.queueWrite(i, saved[i]);
+    }
+  }
+  _device.runBatch();
+
+  return true;
+}
@@ -0,0 +1,92 @@
+/*
+    drvBench.h - microbenchmarks for the drv public API
+
+    Created by REV for SEM.
+
+    Times every public drv call over a number of iterations and prints one
+    CSV row per call:
+    bench,mode,name,iterations,min_us,median_us,p99_us,frames,log_bytes
+    frames and log_bytes are per call (averaged). Timing uses micros(), so
+    on an AVR board resolution is 4 us; on the host it is the simulated bus
+    time (see hostsim).
+
+    The bridge must be off, setters are run with harmless values and the
+    registers are restored afterwards. The isr calls run from loop() here,
+    so their rows are the frame cost without interrupt entry. The
+    sleep+wake row (nSLEEP low, then wake(true) with its WAKE_MICROS wait
+    and register restore) only runs once setSleepPin has been called.
+
+    Usage:
+    drvBench bench(sailboat, logger);
+    bench.run("verify-every");
+    sailboat.setVerifyPolicy(drv::VERIFY_NEVER);
+    bench.run("verify-never");
+
+    Dependencies:
+
+    drv Library.
+    REV Logger Library.
+
+*/
+#ifndef drvBench_h
+#define drvBench_h
+
+#include <Arduino.h>
+#include "drv.h"
+#include "Logger.h"
+
+class drvBench {
+    public:
+
+        // most iterations timed per call
+        static const int MAX_SAMPLES = 64;
+
+        /*
+        one benchmarked call, i is the iteration number
+        */
+        typedef void (*Call)(drv& device, unsigned int i);
+
+        struct Result {
+            const char* name;
+            unsigned int iterations;
+            unsigned long minMicros;
+            unsigned long medianMicros;
+            unsigned long p99Micros;
+            unsigned long frames;   // per call
+            unsigned long logBytes; // per call
+        };
+
+        drvBench(drv& device, Logger& log);
+
+        /*
+        benchmarks one call and prints its row
+        */
+        Result measure(const char* mode, const char* name, Call call, unsigned int iterations = MAX_SAMPLES);
+
+        /*
+        benchmarks every public drv call
+        mode: written in the mode column, to tell configurations apart
+        returns false if the bridge is on
+        */
+        bool run(const char* mode, unsigned int iterations = MAX_SAMPLES);
+
+        /*
+        prints the CSV header
+        */
+        static void printHeader();
+
+    private:
+
+        drv& _device;
+
+        // calls that need drv's private members
+        static void benchCheckedRead(drv& device, unsigned int i);
+        static void benchSleepWake(drv& device, unsigned int i);
+
+        Logger& _log;
+        unsigned long _samples[MAX_SAMPLES];
+
+        void print(const char* mode, const Result& result);
+};
+
+#endif
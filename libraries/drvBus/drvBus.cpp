@@ -0,0 +1,162 @@
+/*
+    drvBus.cpp - several DRV8704s (or other drvs) sharing one SPI bus
+
+    Created by REV for SEM.
+
+    ** see drvBus.h for full doc **
+
+*/
+#include <SPI.h>
+#include <Arduino.h>
+#include "drv.h"
+#include "drvBus.h"
+
+drvBus::drvBus() {
+  _count = 0;
+  _pollPeriod = 0;
+  _lastPoll = 0;
+  _next = 0;
+  _openClock = 0;
+  maxPollGap = 0;
+}
+
+int drvBus::attach(drv& device) {
+  if (_count >= MAX_DEVICES) {
+    return -1;
+  }
+  _devices[_count] = &device;
+  _lastPolled[_count] = micros();
+  return _count++;
+}
+
+int drvBus::devices() {
+  return _count;
+}
+
+drv& drvBus::device(int index) {
+  return *_devices[index];
+}
+
+void drvBus::claim(drv& device) {
+  if (_openClock == device.clock()) {
+    return;
+  }
+  release();
+  SPI.beginTransaction(device.settings());
+  _openClock = device.clock();
+}
+
+void drvBus::release() {
+  if (_openClock != 0) {
+    SPI.endTransaction();
+    _openClock = 0;
+  }
+}
+
+int drvBus::broadcast(unsigned int address, unsigned int value) {
+  for (int i = 0; i < _count; i++) {
+    claim(*_devices[i]);
+    _devices[i]->transfer((address << 12) | (value & 0xFFF)); // MSB clear to write
+    _devices[i]->journal(address, _devices[i]->currentRegisterValues[address], value & 0xFFF, drvFields::SOURCE_BUS);
+    _devices[i]->store(address, value);
+  }
+  release();
+  return _count;
+}
+
+void drvBus::broadcastBits(unsigned int address, unsigned int mask, unsigned int bits) {
+  /*
+  Each device keeps its own bits outside mask, taken from its shadow.
+  Shadows are seeded before the bus is claimed since that reads over SPI.
+  */
+  for (int i = 0; i < _count; i++) {
+    _devices[i]->cached(address);
+  }
+
+  for (int i = 0; i < _count; i++) {
+    drv& device = *_devices[i];
+    unsigned int outgoing = (device.currentRegisterValues[address] & ~mask) | (bits & mask);
+    claim(device);
+    device.transfer((address << 12) | (outgoing & 0xFFF));
+    device.journal(address, device.currentRegisterValues[address], outgoing & 0xFFF, drvFields::SOURCE_BUS);
+    device.store(address, outgoing);
+  }
+  release();
+}
+
+unsigned char drvBus::pollAll() {
+  unsigned int status[MAX_DEVICES];
+  bool sane[MAX_DEVICES];
+  unsigned char faulted = 0;
+
+  // read everything first, fault callbacks may use the bus
+  for (int i = 0; i < _count; i++) {
+    claim(*_devices[i]);
+    status[i] = _devices[i]->checkedRead(0x7, true, sane[i]) & 0x3F; // STATUS
+  }
+  release();
+
+  // a frame that failed every retry is a bus failure, not a fault
+  for (int i = 0; i < _count; i++) {
+    if (!sane[i]) {
+      continue;
+    }
+    recordPoll(i, status[i]);
+    if (status[i]) {
+      faulted |= 1 << i;
+    }
+  }
+  return faulted;
+}
+
+bool drvBus::poll(int index) {
+  bool sane;
+  claim(*_devices[index]);
+  unsigned int status = _devices[index]->checkedRead(0x7, true, sane) & 0x3F; // STATUS
+  release();
+
+  if (!sane) {
+    return false;
+  }
+  recordPoll(index, status);
+  return status != 0;
+}
+
+void drvBus::recordPoll(int index, unsigned int status) {
+  unsigned long now = micros();
+  if (now - _lastPolled[index] > maxPollGap) {
+    maxPollGap = now - _lastPolled[index];
+  }
+  _lastPolled[index] = now;
+
+  drv& device = *_devices[index];
+  device.journal(0x7 | drv::JOURNAL_READ, device.currentRegisterValues[0x7], status, drvFields::SOURCE_BUS);
+  device.store(0x7, status);
+  device.updateFaults(status);
+}
+
+void drvBus::setPollPeriod(unsigned long us) {
+  _pollPeriod = us;
+  _lastPoll = micros();
+  maxPollGap = 0;
+  for (int i = 0; i < _count; i++) {
+    _lastPolled[i] = _lastPoll;
+  }
+}
+
+int drvBus::service() {
+  if (_pollPeriod == 0 || _count == 0) {
+    return -1;
+  }
+
+  unsigned long now = micros();
+  if (now - _lastPoll < _pollPeriod) {
+    return -1;
+  }
+  _lastPoll = now;
+
+  int polled = _next;
+  poll(polled);
+  _next = (_next + 1) % _count;
+  return polled;
+}
@@ -0,0 +1,131 @@
+/*
+    drvBus.h - several DRV8704s (or other drvs) sharing one SPI bus
+
+    Created by REV for SEM.
+
+    Keeps each device's SPI settings and runs frames for several devices
+    back-to-back inside as few transactions as possible: one per run of
+    devices with the same clock. STATUS is polled round-robin, one device
+    per poll period, so every device is polled at least once every
+    devices() * poll period.
+
+    Usage:
+    drvBus bus;
+    bus.attach(left);
+    bus.attach(right);
+    bus.broadcast<drvFields::TORQUE>(0x70);
+    bus.setPollPeriod(1000);
+    ... in loop(): bus.service();
+
+    Dependencies:
+
+    drv Library.
+
+*/
+#ifndef drvBus_h
+#define drvBus_h
+
+#include <Arduino.h>
+#include <SPI.h>
+#include "drv.h"
+
+class drvBus {
+    public:
+
+        static const int MAX_DEVICES = 4;
+
+        drvBus();
+
+        /*
+        adds a device to the bus
+        returns its index, -1 if the bus is full
+        */
+        int attach(drv& device);
+
+        /*
+        number of attached devices
+        */
+        int devices();
+
+        drv& device(int index);
+
+        /*
+        writes the same 12 bit value to a register of every device
+        returns the number of frames sent
+        */
+        int broadcast(unsigned int address, unsigned int value);
+
+        /*
+        sets a field (see drvFields.h) on every device, keeping each
+        device's other bits from its shadow registers
+        returns false if value isn't valid for the field
+        */
+        template <class Field>
+        bool broadcast(long value) {
+            int code = Field::encode(value);
+            if (code < 0) {
+                return false;
+            }
+            broadcastBits(Field::reg, Field::mask, (unsigned int)code << Field::shift);
+            return true;
+        }
+
+        /*
+        reads STATUS of every device, back-to-back. Frames are checked and
+        retried like drv::read, one that fails every retry counts as a bus
+        failure and leaves that device's fault state alone.
+        returns a mask of devices with active faults
+        */
+        unsigned char pollAll();
+
+        /*
+        reads STATUS of one device, checked like pollAll
+        returns true if it has an active fault
+        */
+        bool poll(int index);
+
+        /*
+        time between round-robin STATUS polls in microseconds (0 stops polling)
+        */
+        void setPollPeriod(unsigned long us);
+
+        /*
+        call from loop(), polls the next device when a poll is due
+        returns the index of the polled device, -1 if none was due
+        */
+        int service();
+
+        /*
+        longest time in microseconds any device went between polls
+        */
+        unsigned long maxPollGap;
+
+    private:
+
+        drv* _devices[MAX_DEVICES];
+        unsigned long _lastPolled[MAX_DEVICES];
+        int _count;
+
+        unsigned long _pollPeriod;
+        unsigned long _lastPoll;
+        int _next;
+
+        // clock of the open transaction, 0 if none is open
+        unsigned long _openClock;
+
+        /*
+        opens a transaction for a device, reusing the open one if the clock matches
+        */
+        void claim(drv& device);
+
+        /*
+        closes the open transaction
+        */
+        void release();
+
+        void broadcastBits(unsigned int address, unsigned int mask, unsigned int bits);
+
+        void recordPoll(int index, unsigned int status);
+};
+
+#endif
@@ -0,0 +1,154 @@
+/*
+    drvCurrent.cpp - fixed-point PI current regulation through the TORQUE register
+
+    Created by REV for SEM.
+
+    ** see drvCurrent.h for full doc **
+
+*/
+#include <Arduino.h>
+#include "drv.h"
+#include "drvCurrent.h"
+
+// largest TORQUE in Q8
+static const long TORQUE_FULL = 255L << 8;
+
+drvCurrent::drvCurrent(drv& device, uint8_t sensePin, unsigned int rsense, unsigned int vref)
+    : _device(device) {
+  _sensePin = sensePin;
+  _rsense = rsense;
+  _vref = vref;
+  _kp = 256;
+  _ki = 0;
+  _maxStep = 255;
+  _target = 0;
+  _countTorque = 0;
+  _targetCounts = 0;
+  _feedforward = 0;
+  _integral = 0;
+  lastSample = 0;
+  lastTorque = 0;
+  updates = 0;
+  saturations = 0;
+}
+
+void drvCurrent::setGains(int kp, int ki) {
+  InterruptLock lock; // the gains are read by update(), maybe in a timer ISR
+  _kp = kp < 0 ? 0 : kp;
+  _ki = ki < 0 ? 0 : ki;
+}
+
+void drvCurrent::setRateLimit(unsigned char maxStep) {
+  _maxStep = maxStep ? maxStep : 1;
+}
+
+void drvCurrent::begin(unsigned int verifyEvery) {
+  {
+    InterruptLock lock;
+    _integral = 0;
+    lastTorque = _device.get<drvFields::TORQUE>();
+  }
+  setTarget(_target);
+  if (!_device.torqueStreamArmed()) {
+    _device.armTorqueStream(verifyEvery);
+  }
+}
+
+void drvCurrent::end() {
+  _device.disarmTorqueStream();
+}
+
+bool drvCurrent::setTarget(unsigned int milliamps) {
+  /*
+  All the divisions happen here, outside the control step. Vref * ISGAIN
+  * 65536 / 11000 is done as * 8192 / 1375 to stay inside 32 bits, and the
+  target in uV (mA * mOhm) goes to ADC counts as * 1024 / (Vref * 1000),
+  i.e. * 128 / (Vref * 125).
+  */
+  unsigned long countTorque = (unsigned long)_vref * _device.getISGain() * 8192UL / 1375UL;
+  unsigned long microvolts = (unsigned long)milliamps * _rsense;
+  unsigned long scale = (unsigned long)_vref * 125UL;
+  unsigned long counts = (microvolts * 128 + scale / 2) / scale;
+
+  // full scale is the smaller of the ADC range and TORQUE 255
+  unsigned long maxCounts = countTorque ? (255UL << 16) / countTorque : 0;
+  if (maxCounts > ADC_MAX) {
+    maxCounts = ADC_MAX;
+  }
+  bool inRange = counts <= maxCounts;
+  if (!inRange) {
+    counts = maxCounts;
+  }
+
+  {
+    InterruptLock lock;
+    _target = milliamps;
+    _countTorque = countTorque;
+    _targetCounts = counts;
+    _feedforward = ((long)counts * (long)countTorque) >> 8;
+  }
+  return inRange;
+}
+
+unsigned char drvCurrent::update() {
+  return update(analogRead(_sensePin));
+}
+
+unsigned char drvCurrent::update(int sample) {
+  /*
+  Everything in TORQUE steps, Q8. The error is clamped to full scale
+  before the gains so the products stay inside 32 bits (65280 * 32767).
+  */
+  lastSample = sample;
+  long error = ((long)(_targetCounts - sample) * _countTorque) >> 8;
+  if (error > TORQUE_FULL) {
+    error = TORQUE_FULL;
+  } else if (error < -TORQUE_FULL) {
+    error = -TORQUE_FULL;
+  }
+
+  long proportional = (error * _kp) >> 8;
+  long step = (error * _ki) >> 8;
+  long integral = _integral + step;
+  if (integral > TORQUE_FULL) {
+    integral = TORQUE_FULL;
+  } else if (integral < -TORQUE_FULL) {
+    integral = -TORQUE_FULL;
+  }
+
+  long output = (_feedforward + proportional + integral) >> 8;
+
+  // range and rate limits
+  int last = lastTorque;
+  int high = last + _maxStep > 255 ? 255 : last + _maxStep;
+  int low = last - _maxStep < 0 ? 0 : last - _maxStep;
+  int torque = output;
+  bool clamped = false;
+  if (output > high) {
+    torque = high;
+    clamped = true;
+  } else if (output < low) {
+    torque = low;
+    clamped = true;
+  }
+
+  // conditional integration: a clamped output only keeps steps back towards the range
+  if (!clamped || (torque == high && step < 0) || (torque == low && step > 0)) {
+    _integral = integral;
+  }
+  if (clamped) {
+    saturations++;
+  }
+
+  if (torque != last) {
+    _device.streamTorque(torque);
+  }
+  lastTorque = torque;
+  updates++;
+  return torque;
+}
+
+unsigned int drvCurrent::milliamps(int sample) {
+  // sample * Vref * 1000 / 1024 / Rsense
+  return ((unsigned long)sample * _vref * 125UL / 128UL) / _rsense;
+}
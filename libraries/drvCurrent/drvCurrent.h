@@ -0,0 +1,135 @@
+/*
+    drvCurrent.h - fixed-point PI current regulation through the TORQUE register
+
+    Created by REV for SEM.
+
+    The DRV8704 chops the bridge current at
+        I = 2.75 V * TORQUE / (256 * ISGAIN * Rsense)
+    so TORQUE sets a current limit, not a current. drvCurrent closes the
+    loop: it samples the sense resistor (xISEN, V = I * Rsense) with the
+    ADC and trims TORQUE until the measured current matches the target.
+
+    The same relation gives the feedforward: one ADC count is worth
+        Vref * ISGAIN / 11000 TORQUE steps (Vref in mV)
+    and the PI terms act on the error converted to TORQUE steps, so kp and
+    ki are plain ratios in Q8 (256 = 1.0) whatever ISGAIN and Rsense are.
+    begin() and setTarget read ISGAIN from the register shadow (getISGain,
+    no SPI).
+
+    update() is integer only (32 bit multiplies, no division, no float),
+    doesn't log and writes TORQUE as one bare frame through the torque
+    stream, so it can run in a timer ISR at kHz rates. It stops integrating
+    while the output is clamped by the 0-255 range or the rate limit
+    (conditional integration) so the integrator doesn't wind up, and moves
+    TORQUE at most maxStep per update.
+
+    While the loop runs the torque stream holds the SPI bus (see
+    drv::armTorqueStream), do other drv calls between end() and begin().
+
+    Usage (full scale 5.4 A at ISGAIN 5 and 100 mOhm, 11 mA per ADC count):
+    analogReference(INTERNAL);                    // 1.1 V reference
+    sailboat.setISGain(ISGain::V5);
+    drvCurrent current(sailboat, A0, 100, 1100);  // xISEN on A0, 100 mOhm
+    current.setGains(128, 16);                    // kp 0.5, ki 1/16
+    current.setRateLimit(4);                      // 4 TORQUE steps per update
+    current.begin();
+    current.setTarget(1500);                      // mA, TORQUE about 70
+    ISR(TIMER2_COMPA_vect) { current.update(); }
+
+    Dependencies:
+
+    drv Library.
+
+*/
+#ifndef drvCurrent_h
+#define drvCurrent_h
+
+#include <Arduino.h>
+#include "drv.h"
+
+class drvCurrent {
+    public:
+
+        // full scale of the AVR ADC
+        static const int ADC_MAX = 1023;
+
+        /*
+        sensePin: analog pin on the sense resistor
+        rsense: sense resistor in milliohms
+        vref: ADC reference in millivolts (1100 with analogReference(INTERNAL))
+        */
+        drvCurrent(drv& device, uint8_t sensePin, unsigned int rsense, unsigned int vref = 5000);
+
+        /*
+        proportional and integral gains, Q8 (256 = 1.0), 0-32767
+        ki is applied once per update, so scale it with the update rate
+        */
+        void setGains(int kp, int ki);
+
+        /*
+        largest TORQUE change per update (1-255)
+        */
+        void setRateLimit(unsigned char maxStep);
+
+        /*
+        starts regulating from the current TORQUE: reads ISGAIN from the
+        shadow, clears the integrator and arms the torque stream
+        verifyEvery: see drv::armTorqueStream
+        */
+        void begin(unsigned int verifyEvery = 0);
+
+        /*
+        stops regulating and releases the SPI bus, TORQUE keeps its last value
+        */
+        void end();
+
+        /*
+        target current in milliamps
+        returns false if it is beyond what ISGAIN and Rsense can regulate
+        (the target is clamped to full scale)
+        */
+        bool setTarget(unsigned int milliamps);
+
+        /*
+        one control step with a fresh analogRead of sensePin
+        returns the TORQUE value written
+        */
+        unsigned char update();
+
+        /*
+        one control step with an ADC sample taken elsewhere (e.g. the ADC
+        complete interrupt)
+        */
+        unsigned char update(int sample);
+
+        /*
+        converts an ADC sample to milliamps
+        */
+        unsigned int milliamps(int sample);
+
+        // last sample and output
+        volatile int lastSample;
+        volatile unsigned char lastTorque;
+
+        // updates run, and updates whose output was clamped
+        volatile unsigned long updates;
+        volatile unsigned long saturations;
+
+    private:
+
+        drv& _device;
+        uint8_t _sensePin;
+        unsigned int _rsense;
+        unsigned int _vref;
+        int _kp;
+        int _ki;
+        unsigned char _maxStep;
+        unsigned int _target; // mA
+
+        long _countTorque;  // TORQUE steps per ADC count, Q16
+        int _targetCounts;
+        long _feedforward;  // TORQUE, Q8
+        long _integral;     // TORQUE, Q8
+};
+
+#endif
@@ -0,0 +1,175 @@
+/*
+    drvPwm.cpp - Timer1 PWM for the DRV8704 bridge inputs, checked against drv's timings
+
+    Created by REV for SEM.
+
+    ** see drvPwm.h for full doc **
+
+*/
+#include <Arduino.h>
+#include "drv.h"
+#include "drvPwm.h"
+
+// Timer1 clock selects for the prescalers begin tries, in order
+static const unsigned int prescalers[] = {1, 8, 64};
+static const uint8_t clockSelects[] = {_BV(CS10), _BV(CS11), _BV(CS11) | _BV(CS10)};
+
+drvPwm::drvPwm(drv& device, uint8_t ain2, uint8_t bin2) : _device(device) {
+  _dirPins[CHANNEL_A] = ain2;
+  _dirPins[CHANNEL_B] = bin2;
+  _reverse[CHANNEL_A] = false;
+  _reverse[CHANNEL_B] = false;
+  _running = false;
+  _prescaler = 1;
+  _top = 0;
+  _minOn = 0;
+  _minOff = 0;
+  clamped = 0;
+}
+
+unsigned char drvPwm::begin(unsigned long frequency) {
+  /*
+  Phase and frequency correct PWM (mode 8): the counter runs 0 -> ICR1 -> 0,
+  so a period is 2 * ICR1 ticks and OCR1A/B are latched at BOTTOM.
+  */
+  if (frequency == 0) {
+    return LIMIT_RANGE;
+  }
+  int clock = -1;
+  unsigned long top = 0;
+  for (int i = 0; i < 3; i++) {
+    top = F_CPU / (2UL * prescalers[i] * frequency);
+    if (top <= 0xFFFF) {
+      clock = i;
+      break;
+    }
+  }
+  if (clock < 0 || top < MIN_TOP) {
+    return LIMIT_RANGE;
+  }
+
+  for (int i = 0; i < 2; i++) {
+    pinMode(_dirPins[i], OUTPUT);
+    digitalWrite(_dirPins[i], LOW);
+    _reverse[i] = false;
+  }
+  pinMode(PWM_A_PIN, OUTPUT);
+  pinMode(PWM_B_PIN, OUTPUT);
+
+  {
+    InterruptLock lock;
+    TCCR1B = 0; // stopped while it's set up
+    TCCR1A = _BV(COM1A1) | _BV(COM1B1);
+    ICR1 = top;
+    OCR1A = 0;
+    OCR1B = 0;
+    TCNT1 = 0;
+    _prescaler = prescalers[clock];
+    _top = top;
+    TCCR1B = _BV(WGM13) | clockSelects[clock];
+    _running = true;
+  }
+
+  return check();
+}
+
+void drvPwm::end() {
+  {
+    InterruptLock lock;
+    TCCR1B = 0;
+    TCCR1A = 0;
+    _running = false;
+  }
+  digitalWrite(PWM_A_PIN, LOW);
+  digitalWrite(PWM_B_PIN, LOW);
+  for (int i = 0; i < 2; i++) {
+    digitalWrite(_dirPins[i], LOW);
+    _reverse[i] = false;
+  }
+}
+
+unsigned char drvPwm::check() {
+  if (!_running) {
+    return LIMIT_RANGE;
+  }
+
+  // ns per duty count (2 timer ticks)
+  unsigned long countNs = 2000UL * _prescaler / (F_CPU / 1000000UL);
+  unsigned long periodNs = (unsigned long)_top * countNs;
+  unsigned long tOff = (_device.get<drvFields::TOFF>() + 1UL) * 525UL;
+  unsigned long tBlank = _device.get<drvFields::TBLANK>() * 21UL;
+  unsigned long dTime = _device.get<drvFields::DTIME>();
+
+  unsigned int minOn = (tBlank + dTime + countNs - 1) / countNs;
+  unsigned int minOff = (dTime + countNs - 1) / countNs;
+
+  {
+    InterruptLock lock;
+    _minOn = minOn;
+    _minOff = minOff;
+  }
+
+  unsigned char limits = LIMIT_OK;
+  if (periodNs < tBlank + tOff) {
+    limits |= LIMIT_CHOP;
+  }
+  if ((unsigned long)minOn + minOff > _top) {
+    limits |= LIMIT_PULSE;
+  }
+  return limits;
+}
+
+void drvPwm::setDuty(Channel channel, int duty) {
+  if (!_running) {
+    return;
+  }
+  bool reverse = duty < 0;
+  unsigned int magnitude = reverse ? -(long)duty : duty;
+  if (magnitude > DUTY_MAX) {
+    magnitude = DUTY_MAX;
+  }
+
+  // DUTY_MAX is 1 << 10
+  unsigned int counts = ((unsigned long)magnitude * _top) >> 10;
+  if (counts > 0 && counts < _minOn) {
+    counts = 0;
+    clamped++;
+  } else if (counts < _top && _top - counts < _minOff) {
+    counts = _top;
+    clamped++;
+  }
+
+  /*
+  The compare registers are 16 bit, written through the shared TEMP
+  byte, so interrupts stay off for the write. The direction pin and the
+  output mode only change on a reversal.
+  */
+  InterruptLock lock;
+  if (reverse != _reverse[channel]) {
+    uint8_t invert = channel == CHANNEL_A ? _BV(COM1A0) : _BV(COM1B0);
+    TCCR1A = reverse ? (TCCR1A | invert) : (TCCR1A & ~invert);
+    digitalWrite(_dirPins[channel], reverse ? HIGH : LOW);
+    _reverse[channel] = reverse;
+  }
+  if (channel == CHANNEL_A) {
+    OCR1A = counts;
+  } else {
+    OCR1B = counts;
+  }
+}
+
+unsigned long drvPwm::frequency() {
+  return _top ? F_CPU / (2UL * _prescaler * _top) : 0;
+}
+
+unsigned int drvPwm::top() {
+  return _top;
+}
+
+unsigned int drvPwm::minOnCounts() {
+  return _minOn;
+}
+
+unsigned int drvPwm::minOffCounts() {
+  return _minOff;
+}
@@ -0,0 +1,130 @@
+/*
+    drvPwm.h - Timer1 PWM for the DRV8704 bridge inputs, checked against drv's timings
+
+    Created by REV for SEM.
+
+    Drives xIN1 of each bridge from a Timer1 compare output (AIN1 on OC1A,
+    pin 9, BIN1 on OC1B, pin 10) and xIN2 from a plain pin that sets the
+    direction. Timer1 runs in phase and frequency correct mode (TOP =
+    ICR1), where OCR1A/B are double buffered by the hardware and only take
+    a new duty at BOTTOM, so duty updates never glitch a period and no
+    interrupt is used.
+
+    Forward (duty > 0): xIN2 low, xIN1 high for the duty, coast between.
+    Reverse (duty < 0): xIN2 high, xIN1 inverted (low for the duty),
+        brake between.
+    A direction change switches the compare output mode at once, not at
+    BOTTOM.
+
+    The DRV8704 chops on its own: after tBLANK it watches the current and
+    once it trips turns the bridge off for tOFF. The PWM shouldn't fight
+    that, so begin() and check() compare the PWM with the register
+    shadow's timings (no SPI):
+        tOFF = (TOFF + 1) * 525 ns, tBLANK = TBLANK * 21 ns, DTIME in ns
+    LIMIT_CHOP     the period is shorter than tBLANK + tOFF, a chop can't
+                   finish inside one PWM period
+    LIMIT_PULSE    the period can't hold the shortest on and off pulses
+    LIMIT_RANGE    Timer1 can't make the frequency (prescaler 1, 8 or 64)
+    On pulses shorter than tBLANK + DTIME (the chopper never sees them)
+    become 0, off pulses shorter than DTIME become full on.
+
+    Call check() after setTOff, setTBlank or setDTime.
+
+    Usage:
+    drvPwm pwm(sailboat, AIN2, BIN2);
+    if (pwm.begin(20000) != drvPwm::LIMIT_OK) { ... }
+    pwm.setDuty(drvPwm::CHANNEL_A, 512);    // forward, half
+    pwm.setDuty(drvPwm::CHANNEL_B, -1024);  // reverse, full
+
+    Dependencies:
+
+    drv Library.
+    An ATmega328P (Uno) Timer1, which also means analogWrite and Servo
+    can't use pins 9 and 10.
+
+*/
+#ifndef drvPwm_h
+#define drvPwm_h
+
+#include <Arduino.h>
+#include "drv.h"
+
+class drvPwm {
+    public:
+
+        // Timer1 compare outputs on the Uno
+        static const uint8_t PWM_A_PIN = 9;  // OC1A -> AIN1
+        static const uint8_t PWM_B_PIN = 10; // OC1B -> BIN1
+
+        // full scale duty
+        static const int DUTY_MAX = 1024;
+
+        // fewest timer counts per period
+        static const unsigned int MIN_TOP = 64;
+
+        enum Channel {
+            CHANNEL_A,
+            CHANNEL_B
+        };
+
+        // limits bitmap returned by begin and check
+        static const unsigned char LIMIT_OK = 0;
+        static const unsigned char LIMIT_CHOP = 1 << 0;
+        static const unsigned char LIMIT_PULSE = 1 << 1;
+        static const unsigned char LIMIT_RANGE = 1 << 2;
+
+        /*
+        ain2, bin2: direction pins wired to AIN2 and BIN2
+        */
+        drvPwm(drv& device, uint8_t ain2, uint8_t bin2);
+
+        /*
+        starts Timer1 at frequency (Hz) with both bridges coasting
+        returns the limits bitmap, the timer isn't started on LIMIT_RANGE
+        */
+        unsigned char begin(unsigned long frequency);
+
+        /*
+        stops Timer1 and sets every input low (both bridges coast)
+        */
+        void end();
+
+        /*
+        rereads TOFF, TBLANK and DTIME from the shadow and recomputes the
+        pulse limits
+        returns the limits bitmap
+        */
+        unsigned char check();
+
+        /*
+        duty: -DUTY_MAX (full reverse) to DUTY_MAX (full forward), taken at
+        the next period boundary
+        can be called from an ISR, the interrupt flag is restored as found
+        */
+        void setDuty(Channel channel, int duty);
+
+        unsigned long frequency();
+
+        // timer counts per half period (ICR1), a duty count is 2 timer ticks
+        unsigned int top();
+
+        // shortest on and off pulses, in duty counts
+        unsigned int minOnCounts();
+        unsigned int minOffCounts();
+
+        // duties moved to 0 or full scale by the pulse limits
+        unsigned long clamped;
+
+    private:
+
+        drv& _device;
+        uint8_t _dirPins[2];
+        bool _reverse[2];
+        bool _running;
+        unsigned int _prescaler;
+        unsigned int _top;
+        unsigned int _minOn;
+        unsigned int _minOff;
+};
+
+#endif
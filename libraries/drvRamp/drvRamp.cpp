@@ -0,0 +1,159 @@
+/*
+    drvRamp.cpp - slew rate limited TORQUE ramps, advanced from a timer tick
+
+    Created by REV for SEM.
+
+    ** see drvRamp.h for full doc **
+
+*/
+#include <Arduino.h>
+#include "drv.h"
+#include "drvRamp.h"
+
+drvRamp::drvRamp(drv& device, unsigned int tickHz) : _device(device) {
+  _tickHz = tickHz ? tickHz : 1;
+  _callback = NULL;
+  _state = RAMP_IDLE;
+  _unreported = false;
+  _abort = false;
+  _shape = RAMP_LINEAR;
+  _start = 0;
+  _target = 0;
+  _distance = 0;
+  _progress = RAMP_END;
+  _rate = RAMP_END;
+  torque = 0;
+  steps = 0;
+  reached = 0;
+  aborted = 0;
+}
+
+void drvRamp::begin() {
+  unsigned char current = _device.get<drvFields::TORQUE>();
+  InterruptLock lock;
+  torque = current;
+  _start = current;
+  _target = current;
+  _distance = 0;
+  _progress = RAMP_END;
+  _unreported = false;
+  _state = RAMP_REACHED;
+}
+
+void drvRamp::end() {
+  InterruptLock lock;
+  _state = RAMP_IDLE;
+  _unreported = false;
+}
+
+bool drvRamp::setTarget(unsigned char target, unsigned int slew, Shape shape) {
+  /*
+  The ramp lasts |target - start| * tickHz / slew ticks, progress runs
+  from 0 to RAMP_END in that many. A ramp shorter than a tick steps.
+  */
+  if (_state == RAMP_IDLE) {
+    return false;
+  }
+
+  unsigned char start = torque;
+  unsigned long distance = target > start ? target - start : start - target;
+  unsigned long ticks = slew ? (distance * _tickHz + slew / 2) / slew : 0;
+  unsigned long rate = ticks ? (RAMP_END + ticks - 1) / ticks : RAMP_END;
+
+  InterruptLock lock; // tick() may run in a timer ISR
+  _shape = shape;
+  _start = torque; // a tick may have moved it, the rate stays close enough
+  _target = target;
+  _distance = target > _start ? target - _start : _start - target;
+  _rate = rate;
+  _progress = 0;
+  _unreported = false;
+  _abort = false;
+  _state = RAMP_RUNNING;
+  return true;
+}
+
+void drvRamp::abort() {
+  // one byte store, safe from an ISR, the next tick ends the ramp
+  _abort = true;
+}
+
+void drvRamp::finish(State state) {
+  _state = state;
+  _unreported = true;
+  _abort = false;
+  if (state == RAMP_REACHED) {
+    reached++;
+  } else {
+    aborted++;
+  }
+}
+
+void drvRamp::tick() {
+  /*
+  u and the shape are in Q16. u^2 is taken from u/2 and the last factor
+  is cut to Q12, so every product stays inside 32 bits.
+  */
+  if (_state != RAMP_RUNNING) {
+    return;
+  }
+  if (_abort || _device.activeFaults != 0 || _device.tripped()) {
+    finish(RAMP_ABORTED);
+    return;
+  }
+
+  _progress += _rate;
+  if (_progress > RAMP_END) {
+    _progress = RAMP_END;
+  }
+
+  unsigned long u = _progress >> 8;
+  unsigned long shaped = u;
+  if (_shape == RAMP_SCURVE) {
+    unsigned long square = ((u >> 1) * (u >> 1)) >> 14;
+    shaped = (square * ((3 * 65536UL - 2 * u) >> 4)) >> 12;
+  }
+  unsigned char moved = ((unsigned long)_distance * shaped + 0x8000) >> 16;
+  unsigned char value = _target >= _start ? _start + moved : _start - moved;
+
+  if (value != torque) {
+    _device.isrTorque(value);
+    torque = value;
+    steps++;
+  }
+  if (_progress == RAMP_END) {
+    finish(RAMP_REACHED);
+  }
+}
+
+bool drvRamp::service() {
+  bool ended;
+  State state;
+  {
+    InterruptLock lock;
+    ended = _unreported;
+    state = _state;
+    _unreported = false;
+  }
+
+  if (ended && _callback != NULL) {
+    _callback(*this, state);
+  }
+  return ended;
+}
+
+void drvRamp::onDone(Callback callback) {
+  _callback = callback;
+}
+
+drvRamp::State drvRamp::state() {
+  return _state;
+}
+
+unsigned char drvRamp::target() {
+  return _target;
+}
+
+void drvRamp::task(void* ramp) {
+  ((drvRamp*)ramp)->tick();
+}
@@ -0,0 +1,152 @@
+/*
+    drvRamp.h - slew rate limited TORQUE ramps, advanced from a timer tick
+
+    Created by REV for SEM.
+
+    Moves TORQUE from where it is to a target at a given slew rate instead
+    of in one step. tick() is called at a fixed rate (tickHz), from a timer
+    ISR or a scheduler task, and sends one TORQUE frame (drv::isrTorque)
+    whenever the ramp's value changes, nothing when it doesn't. Other drv
+    calls from loop() keep working during a ramp.
+
+    Shapes, over the same duration |target - start| / slew:
+    RAMP_LINEAR - constant slew
+    RAMP_SCURVE - smoothstep (3u^2 - 2u^3), starts and ends at zero slew,
+        peaks at 1.5 times slew in the middle
+
+    tick() is integer only (32 bit multiplies, no division) and doesn't
+    log, setTarget does the division. The calls that share state with
+    tick() mask interrupts with drv's InterruptLock, which leaves them off
+    when called from an ISR. A new target preempts the ramp
+    under way: the new one starts from the value reached, from zero slew
+    for an S-curve. A fault (drv::activeFaults, as kept by serviceFaults)
+    or a trip (drv::isrTrip) aborts the ramp on the next tick and TORQUE
+    stays where it was.
+
+    The end of a ramp is reported by state(), and by the callback, which
+    service() calls from loop() rather than from the tick.
+
+    Usage:
+    drvRamp ramp(sailboat, 1000);                       // ticked at 1 kHz
+    ramp.begin();
+    ramp.setTarget(0xC0, 200, drvRamp::RAMP_SCURVE);    // 200 steps/s
+    ISR(TIMER2_COMPA_vect) { ramp.tick(); }
+    void loop() { ramp.service(); }
+
+    Dependencies:
+
+    drv Library.
+
+*/
+#ifndef drvRamp_h
+#define drvRamp_h
+
+#include <Arduino.h>
+#include "drv.h"
+
+class drvRamp {
+    public:
+
+        enum Shape {
+            RAMP_LINEAR,
+            RAMP_SCURVE
+        };
+
+        enum State {
+            RAMP_IDLE,    // not begun, or ended
+            RAMP_RUNNING,
+            RAMP_REACHED, // holding the target
+            RAMP_ABORTED  // stopped by a fault, a trip or abort()
+        };
+
+        /*
+        called from service() when a ramp ends
+        state: RAMP_REACHED or RAMP_ABORTED
+        */
+        typedef void (*Callback)(drvRamp& ramp, State state);
+
+        /*
+        tickHz: rate tick() is called at
+        */
+        drvRamp(drv& device, unsigned int tickHz);
+
+        /*
+        starts from the current TORQUE (from the shadow) and holds it
+        */
+        void begin();
+
+        /*
+        stops ticking, TORQUE keeps its last value
+        */
+        void end();
+
+        /*
+        ramps to target (0-255)
+        slew: TORQUE steps per second, 0 steps straight to the target
+        returns false if not begun
+        */
+        bool setTarget(unsigned char target, unsigned int slew, Shape shape = RAMP_LINEAR);
+
+        /*
+        stops the ramp where it is on the next tick, can be called from
+        an ISR. A setTarget before that tick wins.
+        */
+        void abort();
+
+        /*
+        advances the ramp one tick, call at tickHz
+        */
+        void tick();
+
+        /*
+        reports a ramp that ended since the last call through the
+        callback, call from loop()
+        returns true if one ended
+        */
+        bool service();
+
+        void onDone(Callback callback);
+
+        State state();
+
+        unsigned char target();
+
+        // last value sent
+        volatile unsigned char torque;
+
+        // TORQUE frames sent, ramps that reached their target, aborted ramps
+        volatile unsigned long steps;
+        volatile unsigned long reached;
+        volatile unsigned long aborted;
+
+        /*
+        scheduler task calling tick(), context is the drvRamp
+        */
+        static void task(void* ramp);
+
+    private:
+
+        drv& _device;
+        unsigned int _tickHz;
+        Callback _callback;
+
+        volatile State _state;
+        volatile bool _unreported;
+        volatile bool _abort;
+        Shape _shape;
+        unsigned char _start;
+        unsigned char _target;
+        unsigned char _distance; // |_target - _start|
+        unsigned long _progress; // 0 to RAMP_END
+        unsigned long _rate;     // progress per tick
+
+        // progress at the end of a ramp, Q24
+        static const unsigned long RAMP_END = 1UL << 24;
+
+        /*
+        ends the ramp in state, from the tick or abort
+        */
+        void finish(State state);
+};
+
+#endif
@@ -0,0 +1,236 @@
+/*
+    drvScheduler.cpp - fixed-period cooperative scheduler for the drv control loop
+
+    Created by REV for SEM.
+
+    ** see drvScheduler.h for full doc **
+
+*/
+#include <Arduino.h>
+#include "drv.h"
+#include "Logger.h"
+#include "drvScheduler.h"
+
+drvScheduler::drvScheduler(unsigned long tickMicros) {
+  _count = 0;
+  _tickMicros = tickMicros ? tickMicros : 1;
+  _tick = 0;
+  _tickStart = micros();
+  _printing = false;
+  _printRow = -1;
+  _printColumn = 0;
+}
+
+int drvScheduler::add(Task task, unsigned long periodMicros, void* context) {
+  if (_count >= MAX_TASKS || periodMicros < _tickMicros) {
+    return -1;
+  }
+  Slot& slot = _tasks[_count];
+  slot.task = task;
+  slot.context = context;
+  slot.period = periodMicros / _tickMicros;
+  slot.due = _tick + 1;
+  slot.enabled = true;
+  memset(&slot.stats, 0, sizeof(slot.stats));
+  return _count++;
+}
+
+void drvScheduler::setEnabled(int task, bool enabled) {
+  if (task < 0 || task >= _count) {
+    return;
+  }
+  if (enabled && !_tasks[task].enabled) {
+    _tasks[task].due = _tick + 1;
+  }
+  _tasks[task].enabled = enabled;
+}
+
+int drvScheduler::run() {
+  /*
+  advances the tick count one tick at a time, which is normally zero or one
+  step per call and avoids a 32 bit division on every pass
+  */
+  unsigned long now = micros();
+  while (now - _tickStart >= _tickMicros) {
+    _tickStart += _tickMicros;
+    _tick++;
+  }
+
+  int ran = 0;
+  for (int i = 0; i < _count; i++) {
+    Slot& slot = _tasks[i];
+    if (!slot.enabled || (long)(_tick - slot.due) < 0) {
+      continue;
+    }
+
+    unsigned long late = _tick - slot.due;
+    if (late >= slot.period) {
+      // missed whole releases, run once and go back on the grid
+      unsigned long missed = late / slot.period;
+      slot.stats.overruns++;
+      slot.stats.skipped += missed;
+      slot.due += missed * slot.period;
+      late -= missed * slot.period;
+    }
+
+    unsigned long start = micros();
+    unsigned long lateMicros = late * _tickMicros + (start - _tickStart);
+    slot.task(slot.context);
+    unsigned long elapsed = micros() - start;
+
+    slot.due += slot.period;
+    slot.stats.runs++;
+    slot.stats.totalMicros += elapsed;
+    if (elapsed > slot.stats.maxMicros) {
+      slot.stats.maxMicros = elapsed;
+    }
+    if (lateMicros > slot.stats.maxLateMicros) {
+      slot.stats.maxLateMicros = lateMicros;
+    }
+    if (elapsed > slot.period * _tickMicros) {
+      slot.stats.overruns++;
+    }
+    ran++;
+  }
+  return ran;
+}
+
+int drvScheduler::tasks() {
+  return _count;
+}
+
+unsigned long drvScheduler::ticks() {
+  return _tick;
+}
+
+unsigned long drvScheduler::overruns() {
+  unsigned long total = 0;
+  for (int i = 0; i < _count; i++) {
+    total += _tasks[i].stats.overruns;
+  }
+  return total;
+}
+
+const drvScheduler::Stats& drvScheduler::stats(int task) {
+  return _tasks[task].stats;
+}
+
+void drvScheduler::resetStats() {
+  for (int i = 0; i < _count; i++) {
+    memset(&_tasks[i].stats, 0, sizeof(_tasks[i].stats));
+  }
+}
+
+void drvScheduler::printStats() {
+  Serial.println(F("sched,task,period_us,runs,overruns,skipped,avg_us,max_us,max_late_us"));
+  for (int i = 0; i < _count; i++) {
+    const Stats& stats = _tasks[i].stats;
+    Serial.print(F("sched,"));
+    Serial.print(i);
+    Serial.print(',');
+    Serial.print(_tasks[i].period * _tickMicros);
+    Serial.print(',');
+    Serial.print(stats.runs);
+    Serial.print(',');
+    Serial.print(stats.overruns);
+    Serial.print(',');
+    Serial.print(stats.skipped);
+    Serial.print(',');
+    Serial.print(stats.runs ? stats.totalMicros / stats.runs : 0);
+    Serial.print(',');
+    Serial.print(stats.maxMicros);
+    Serial.print(',');
+    Serial.println(stats.maxLateMicros);
+  }
+}
+
+// columns of the statistics table
+static const unsigned char STATS_COLUMNS = 9;
+
+// widest column: a comma, 10 digits and the line end
+static const int STATS_COLUMN_MAX = 13;
+
+static const char statsName0[] PROGMEM = "sched";
+static const char statsName1[] PROGMEM = "task";
+static const char statsName2[] PROGMEM = "period_us";
+static const char statsName3[] PROGMEM = "runs";
+static const char statsName4[] PROGMEM = "overruns";
+static const char statsName5[] PROGMEM = "skipped";
+static const char statsName6[] PROGMEM = "avg_us";
+static const char statsName7[] PROGMEM = "max_us";
+static const char statsName8[] PROGMEM = "max_late_us";
+static const char* const statsNames[STATS_COLUMNS] PROGMEM = {
+  statsName0, statsName1, statsName2, statsName3, statsName4,
+  statsName5, statsName6, statsName7, statsName8
+};
+
+void drvScheduler::beginPrint() {
+  _printing = true;
+  _printRow = -1;
+  _printColumn = 0;
+}
+
+bool drvScheduler::printStep() {
+  /*
+  A column only goes out when the transmit buffer can take all of it,
+  so Serial.print never waits for the port to drain.
+  */
+  while (_printing) {
+    if (Serial.availableForWrite() < STATS_COLUMN_MAX) {
+      return true;
+    }
+    if (_printColumn > 0) {
+      Serial.print(',');
+    }
+    printColumn(_printRow, _printColumn);
+    if (++_printColumn == STATS_COLUMNS) {
+      Serial.println();
+      _printColumn = 0;
+      _printRow++;
+      _printing = _printRow < _count;
+    }
+  }
+  return false;
+}
+
+void drvScheduler::printColumn(int row, unsigned char column) {
+  if (row < 0 || column == 0) {
+    Serial.print((const __FlashStringHelper*)pgm_read_ptr(&statsNames[row < 0 ? column : 0]));
+    return;
+  }
+  const Stats& stats = _tasks[row].stats;
+  switch (column) {
+    case 1: Serial.print(row); break;
+    case 2: Serial.print(_tasks[row].period * _tickMicros); break;
+    case 3: Serial.print(stats.runs); break;
+    case 4: Serial.print(stats.overruns); break;
+    case 5: Serial.print(stats.skipped); break;
+    case 6: Serial.print(stats.runs ? stats.totalMicros / stats.runs : 0); break;
+    case 7: Serial.print(stats.maxMicros); break;
+    default: Serial.print(stats.maxLateMicros); break;
+  }
+}
+
+void drvScheduler::faultTask(void* device) {
+  ((drv*)device)->serviceFaults();
+}
+
+void drvScheduler::wakeTask(void* device) {
+  ((drv*)device)->serviceWake();
+}
+
+void drvScheduler::torqueStreamTask(void* device) {
+  ((drv*)device)->serviceTorqueStream();
+}
+
+void drvScheduler::journalTask(void* device) {
+  ((drv*)device)->serviceJournalDump();
+}
+
+void drvScheduler::logTask(void* log) {
+  ((Logger*)log)->drain();
+}
+
+void drvScheduler::printTask(void* scheduler) {
+  ((drvScheduler*)scheduler)->printStep();
+}
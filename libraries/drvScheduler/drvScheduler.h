@@ -0,0 +1,173 @@
+/*
+    drvScheduler.h - fixed-period cooperative scheduler for the drv control loop
+
+    Created by REV for SEM.
+
+    Runs a small table of tasks, each at a fixed period, from loop(). Time is
+    counted in ticks of tickMicros (from micros()), and a task's next release
+    is its last release plus its period, never "now plus period", so rates
+    don't drift however long loop() takes. Tasks run in the order they were
+    added, at most once per run() call, so an earlier task has priority.
+
+    A task overruns when it runs longer than its period, or when it starts a
+    whole period or more after its release; in the second case the missed
+    releases are counted as skipped and the task is put back on its grid,
+    never run several times to catch up. Every task keeps run count,
+    overruns, skipped releases, worst and total execution time and worst
+    start lateness, printed as CSV:
+    sched,task,period_us,runs,overruns,skipped,avg_us,max_us,max_late_us
+    printStats prints the whole table at once and waits on the serial port
+    (setup, debugging). From a task use beginPrint, with printTask (or
+    printStep) sending it a column at a time as the transmit buffer frees
+    up, so printing never stalls the loop.
+
+    Tasks must not block (no delay(), no sailboat.wake(true)), a long task
+    shows up as an overrun of itself and lateness of the others.
+
+    Usage:
+    drvScheduler scheduler;                 // 1000 us ticks
+    scheduler.add(torqueTask, 1000);        // 1 kHz
+    scheduler.add(drvScheduler::faultTask, 10000, &sailboat); // STATUS at 100 Hz
+    scheduler.add(telemetryTask, 100000);   // 10 Hz
+    scheduler.add(drvScheduler::printTask, 20000, &scheduler); // stats, when begun
+    void loop() { scheduler.run(); }
+
+    Dependencies:
+
+    drv Library.
+    REV Logger Library.
+
+*/
+#ifndef drvScheduler_h
+#define drvScheduler_h
+
+#include <Arduino.h>
+#include "drv.h"
+#include "Logger.h"
+
+class drvScheduler {
+    public:
+
+        static const int MAX_TASKS = 8;
+
+        /*
+        one task, context is the pointer given to add
+        */
+        typedef void (*Task)(void* context);
+
+        struct Stats {
+            unsigned long runs;
+            unsigned long overruns;     // ran longer than the period or started a period late
+            unsigned long skipped;      // releases dropped by late starts
+            unsigned long maxMicros;    // worst execution time
+            unsigned long totalMicros;  // execution time of all runs
+            unsigned long maxLateMicros; // worst start after release
+        };
+
+        /*
+        tickMicros: scheduling resolution, periods are rounded down to it
+        */
+        drvScheduler(unsigned long tickMicros = 1000);
+
+        /*
+        adds a task released every periodMicros, the first release is on the
+        next tick
+        returns the task's index, -1 if the table is full or the period is
+        shorter than a tick
+        */
+        int add(Task task, unsigned long periodMicros, void* context = NULL);
+
+        /*
+        stops or restarts a task, a restarted task is released on the next tick
+        */
+        void setEnabled(int task, bool enabled);
+
+        /*
+        runs every task whose release has come, call from loop() as often
+        as possible
+        returns the number of tasks run
+        */
+        int run();
+
+        /*
+        number of tasks added
+        */
+        int tasks();
+
+        /*
+        ticks since the scheduler was made
+        */
+        unsigned long ticks();
+
+        /*
+        overruns of every task together
+        */
+        unsigned long overruns();
+
+        /*
+        statistics of a task
+        */
+        const Stats& stats(int task);
+
+        /*
+        clears the statistics of every task
+        */
+        void resetStats();
+
+        /*
+        prints the header and one CSV row per task, blocking
+        */
+        void printStats();
+
+        /*
+        starts printing the table through printStep, from the header,
+        whatever part of a previous table is still unsent is dropped
+        */
+        void beginPrint();
+
+        /*
+        prints the next columns of the table, as many as the serial
+        transmit buffer has room for
+        returns true while some of the table is left
+        */
+        bool printStep();
+
+        /*
+        ready made tasks for a drv (context) or a Logger (logTask)
+        */
+        static void faultTask(void* device);        // drv::serviceFaults
+        static void wakeTask(void* device);         // drv::serviceWake
+        static void torqueStreamTask(void* device); // drv::serviceTorqueStream
+        static void journalTask(void* device);      // drv::serviceJournalDump
+        static void logTask(void* log);             // Logger::drain
+        static void printTask(void* scheduler);     // drvScheduler::printStep
+
+    private:
+
+        struct Slot {
+            Task task;
+            void* context;
+            unsigned long period; // ticks
+            unsigned long due;    // tick of the next release
+            bool enabled;
+            Stats stats;
+        };
+
+        Slot _tasks[MAX_TASKS];
+        int _count;
+        unsigned long _tickMicros;
+        unsigned long _tick;
+        unsigned long _tickStart; // micros() at the start of _tick
+
+        // table printing, row -1 is the header
+        bool _printing;
+        int _printRow;
+        unsigned char _printColumn;
+
+        /*
+        prints one column of a row of the table
+        */
+        void printColumn(int row, unsigned char column);
+};
+
+#endif
@@ -0,0 +1,182 @@
+/*
+    drvTelemetry.cpp - rate limited, delta encoded binary snapshots of a drv
+
+    Created by REV for SEM.
+
+    ** see drvTelemetry.h for full doc **
+
+*/
+#include <Arduino.h>
+#include "drv.h"
+#include "drvScheduler.h"
+#include "Logger.h"
+#include "drvTelemetry.h"
+
+static_assert(TELEMETRY_FRAME_MAX <= LOG_FRAME_MAX, "telemetry frame longer than a Logger frame record");
+static_assert(TELEMETRY_FIELDS <= 8 * TELEMETRY_MASK_SIZE, "telemetry fields don't fit the mask");
+
+// register address of TELEMETRY_CTRL + i
+static const unsigned char telemetryRegisters[7] = {0x0, 0x1, 0x2, 0x3, 0x4, 0x6, 0x7};
+
+// stores value little endian, returns the position after it
+static unsigned char* put(unsigned char* at, unsigned long value, unsigned char size) {
+  for (unsigned char i = 0; i < size; i++) {
+    *at++ = (value >> (8 * i)) & 0xFF;
+  }
+  return at;
+}
+
+static unsigned int clamp16(unsigned long value) {
+  return value > 0xFFFF ? 0xFFFF : value;
+}
+
+drvTelemetry::drvTelemetry(drv& device, Logger& log) : _device(device), _log(log) {
+  _scheduler = NULL;
+  _period = 0;
+  _last = micros();
+  _keyEvery = 10;
+  _sinceKey = 0;
+  _sequence = 0;
+  _live = false;
+  _havePrevious = false;
+  sent = 0;
+  dropped = 0;
+}
+
+void drvTelemetry::setRate(unsigned int hz) {
+  _period = hz ? 1000000UL / hz : 0;
+  _last = micros();
+}
+
+void drvTelemetry::setKeyEvery(unsigned char frames) {
+  _keyEvery = frames ? frames : 1;
+}
+
+void drvTelemetry::setLive(bool live) {
+  _live = live;
+}
+
+void drvTelemetry::setScheduler(drvScheduler& scheduler) {
+  _scheduler = &scheduler;
+}
+
+bool drvTelemetry::service() {
+  /*
+  Snapshots stay on a fixed grid like the scheduler's releases. After a
+  stall the grid restarts from now rather than sending a burst.
+  */
+  if (_period == 0) {
+    return false;
+  }
+  unsigned long now = micros();
+  if (now - _last < _period) {
+    return false;
+  }
+  _last = now - _last < 2 * _period ? _last + _period : now;
+  return send();
+}
+
+void drvTelemetry::task(void* telemetry) {
+  ((drvTelemetry*)telemetry)->service();
+}
+
+void drvTelemetry::snapshot(unsigned char* snapshot) {
+  /*
+  Registers and counters are copied with interrupts off, so a torque push
+  or fault from an ISR can't land halfway through the copy.
+  */
+  if (_live && !_device.torqueStreamArmed()) {
+    _device.getCurrentRegisters();
+  } else {
+    _device.cached(0); // seeds the shadow from the chip the first time only
+  }
+
+  unsigned int registers[7];
+  unsigned long frames;
+  noInterrupts();
+  for (int i = 0; i < 7; i++) {
+    registers[i] = _device.currentRegisterValues[telemetryRegisters[i]];
+  }
+  unsigned char faults = _device.activeFaults;
+  frames = _device.frameCount;
+  unsigned int verifyErrors = _device.verifyErrors;
+  unsigned int streamErrors = _device.streamErrors;
+  unsigned int busRetries = _device.busRetries;
+  unsigned int busFailures = _device.busFailures;
+  unsigned long regErrors = 0;
+  for (int i = 0; i < 8; i++) {
+    regErrors += _device.regErrors[i];
+  }
+  interrupts();
+
+  unsigned long overruns = 0;
+  unsigned long loopMax = 0;
+  unsigned long loopLate = 0;
+  if (_scheduler != NULL) {
+    overruns = _scheduler->overruns();
+    for (int i = 0; i < _scheduler->tasks(); i++) {
+      const drvScheduler::Stats& stats = _scheduler->stats(i);
+      if (stats.maxMicros > loopMax) {
+        loopMax = stats.maxMicros;
+      }
+      if (stats.maxLateMicros > loopLate) {
+        loopLate = stats.maxLateMicros;
+      }
+    }
+  }
+
+  unsigned char* at = put(snapshot, micros(), 4);
+  for (int i = 0; i < 7; i++) {
+    at = put(at, registers[i], 2);
+  }
+  at = put(at, faults, 1);
+  at = put(at, frames, 4);
+  at = put(at, verifyErrors, 2);
+  at = put(at, streamErrors, 2);
+  at = put(at, busRetries, 2);
+  at = put(at, busFailures, 2);
+  at = put(at, clamp16(regErrors), 2);
+  at = put(at, clamp16(overruns), 2);
+  at = put(at, clamp16(loopMax), 2);
+  put(at, clamp16(loopLate), 2);
+}
+
+bool drvTelemetry::send() {
+  unsigned char current[TELEMETRY_SNAPSHOT_SIZE];
+  snapshot(current);
+
+  // a key frame every _keyEvery frames, deltas against the last frame sent between them
+  bool key = !_havePrevious || _sinceKey + 1 >= _keyEvery;
+
+  unsigned char frame[TELEMETRY_FRAME_MAX];
+  unsigned char length = 2 + TELEMETRY_MASK_SIZE;
+  unsigned long mask = 0;
+  unsigned char offset = 0;
+  for (unsigned char f = 0; f < TELEMETRY_FIELDS; f++) {
+    unsigned char size = pgm_read_byte(&telemetrySizes[f]);
+    if (key || f == TELEMETRY_TIME || memcmp(&current[offset], &_previous[offset], size) != 0) {
+      memcpy(&frame[length], &current[offset], size);
+      length += size;
+      mask |= 1UL << f;
+    }
+    offset += size;
+  }
+  frame[0] = TELEMETRY_ID;
+  frame[1] = _sequence;
+  put(&frame[2], mask, TELEMETRY_MASK_SIZE);
+  put(&frame[length], telemetryCrc(frame, length), 2);
+  length += 2;
+
+  if (!_log.logFrame(frame, length)) {
+    // nothing was sent, the next delta is still against _previous
+    dropped++;
+    return false;
+  }
+
+  memcpy(_previous, current, sizeof(_previous));
+  _havePrevious = true;
+  _sinceKey = key ? 0 : _sinceKey + 1;
+  _sequence++;
+  sent++;
+  return true;
+}
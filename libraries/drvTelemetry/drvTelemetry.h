@@ -0,0 +1,175 @@
+/*
+    drvTelemetry.h - rate limited, delta encoded binary snapshots of a drv
+
+    Created by REV for SEM.
+
+    Every period drvTelemetry takes one snapshot of the driver (registers,
+    fault bits, SPI and bus health counters and, given a scheduler, loop
+    timing) and sends
+    it as a Logger frame record (see Logger::logFrame), so it shares the
+    serial port with the log without splitting records and never blocks.
+    A snapshot that doesn't fit is dropped, not queued.
+
+    Registers come from the shadow by default, which costs no SPI; STATUS
+    there is as fresh as the fault monitor keeps it. setLive(true) reads
+    all registers in one batch (getCurrentRegisters) for every snapshot,
+    unless the torque stream holds the bus. Live reads show in the journal
+    as SYNC.
+
+    FRAME (the frame record's data, all multi byte values little endian):
+        TELEMETRY_ID ('T'), sequence, field mask (3),
+        the fields whose mask bit is set, in TelemetryField order,
+        CRC-16/CCITT (2, 0xFFFF start, over everything before it)
+    A key frame has every bit of the mask set; the others carry only the
+    fields that changed since the previous frame sent (TIME always does).
+    One frame in keyEvery is a key frame, so a decoder that missed a frame
+    (sequence gap) waits for the next one. tools/telemetry writes the
+    frames out as CSV.
+
+    Usage:
+    drvTelemetry telemetry(sailboat, logger);
+    telemetry.setRate(10);                      // Hz
+    telemetry.setScheduler(scheduler);          // loop timing fields
+    scheduler.add(drvTelemetry::task, 10000, &telemetry);
+
+    Dependencies:
+
+    drv Library.
+    drvScheduler Library.
+    REV Logger Library.
+
+*/
+#ifndef drvTelemetry_h
+#define drvTelemetry_h
+
+#include <Arduino.h>
+#include "drv.h"
+#include "drvScheduler.h"
+#include "Logger.h"
+
+// first byte of a telemetry frame record
+const unsigned char TELEMETRY_ID = 'T';
+
+/*
+snapshot fields, in frame order
+*/
+enum TelemetryField {
+    TELEMETRY_TIME,          // micros of the snapshot (4)
+    TELEMETRY_CTRL,          // registers, 12 bits (2 each)
+    TELEMETRY_TORQUE,
+    TELEMETRY_OFF,
+    TELEMETRY_BLANK,
+    TELEMETRY_DECAY,
+    TELEMETRY_DRIVE,
+    TELEMETRY_STATUS,
+    TELEMETRY_FAULTS,        // drv::activeFaults (1)
+    TELEMETRY_FRAMES,        // drv::frameCount (4)
+    TELEMETRY_VERIFY_ERRORS, // drv::verifyErrors (2)
+    TELEMETRY_STREAM_ERRORS, // drv::streamErrors (2)
+    TELEMETRY_BUS_RETRIES,   // drv::busRetries (2)
+    TELEMETRY_BUS_FAILURES,  // drv::busFailures (2)
+    TELEMETRY_REG_ERRORS,    // drv::regErrors, all registers (2)
+    TELEMETRY_OVERRUNS,      // scheduler overruns, all tasks (2)
+    TELEMETRY_LOOP_MAX,      // worst task execution, us (2)
+    TELEMETRY_LOOP_LATE,     // worst task start lateness, us (2)
+    TELEMETRY_FIELDS
+};
+
+// bytes of each field
+const unsigned char telemetrySizes[TELEMETRY_FIELDS] PROGMEM = {
+    4, 2, 2, 2, 2, 2, 2, 2, 1, 4, 2, 2, 2, 2, 2, 2, 2, 2
+};
+
+// bytes of a whole snapshot
+const unsigned char TELEMETRY_SNAPSHOT_SIZE = 39;
+
+// bytes of the field mask
+const unsigned char TELEMETRY_MASK_SIZE = 3;
+
+// mask of a key frame
+const unsigned long TELEMETRY_KEY = (1UL << TELEMETRY_FIELDS) - 1;
+
+// id, sequence, mask, snapshot, CRC
+const unsigned char TELEMETRY_FRAME_MAX = 2 + TELEMETRY_MASK_SIZE + TELEMETRY_SNAPSHOT_SIZE + 2;
+
+/*
+CRC-16/CCITT of a frame, crc: 0xFFFF to start
+*/
+inline unsigned int telemetryCrc(const unsigned char* data, unsigned char length, unsigned int crc = 0xFFFF) {
+    for (unsigned char i = 0; i < length; i++) {
+        crc ^= (unsigned int)data[i] << 8;
+        for (unsigned char bit = 0; bit < 8; bit++) {
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+        crc &= 0xFFFF;
+    }
+    return crc;
+}
+
+class drvTelemetry {
+    public:
+
+        drvTelemetry(drv& device, Logger& log);
+
+        /*
+        snapshots per second, 0 stops them (the default)
+        */
+        void setRate(unsigned int hz);
+
+        /*
+        sends a key frame once every frames frames (1 sends only key frames)
+        */
+        void setKeyEvery(unsigned char frames);
+
+        /*
+        true: registers are read from the chip for every snapshot
+        false: registers come from the shadow (default)
+        */
+        void setLive(bool live);
+
+        /*
+        fills the loop timing fields from scheduler's task statistics
+        */
+        void setScheduler(drvScheduler& scheduler);
+
+        /*
+        sends a snapshot if one is due, call from loop() or a task
+        returns true if a frame was sent
+        */
+        bool service();
+
+        /*
+        takes and sends a snapshot now, whatever the rate
+        returns false if the frame was dropped
+        */
+        bool send();
+
+        /*
+        scheduler task calling service(), context is the drvTelemetry
+        */
+        static void task(void* telemetry);
+
+        // frames sent, and snapshots dropped for lack of room
+        unsigned long sent;
+        unsigned long dropped;
+
+    private:
+
+        drv& _device;
+        Logger& _log;
+        drvScheduler* _scheduler;
+
+        unsigned long _period;  // micros, 0 is off
+        unsigned long _last;
+        unsigned char _keyEvery;
+        unsigned char _sinceKey;
+        unsigned char _sequence;
+        bool _live;
+        bool _havePrevious;
+
+        unsigned char _previous[TELEMETRY_SNAPSHOT_SIZE]; // last snapshot sent
+
+        void snapshot(unsigned char* snapshot);
+};
+
+#endif
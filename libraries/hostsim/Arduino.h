@@ -0,0 +1,141 @@
+/*
+    Arduino.h - host side stand-in for the Arduino core
+
+    Created by REV for SEM.
+
+    Lets the REV libraries build and run on Linux. Only the parts of the
+    Arduino API used by drv, Logger and friends are provided. Time is
+    simulated (see hostsim.h), pins are plain variables.
+
+    Usage:
+    put libraries/hostsim first on the include path, e.g.
+    g++ -Ilibraries/hostsim -Ilibraries/drv -Ilibraries/Logger ...
+
+*/
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+#define NOT_AN_INTERRUPT -1
+
+// analog inputs of the Uno
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+
+#define DEC 10
+#define HEX 16
+#define BIN 2
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+// flash is ordinary memory on the host
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_word(addr) (*(const uint16_t*)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t*)(addr))
+#define pgm_read_ptr(addr) (*(void* const*)(addr))
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strcpy_P strcpy
+#define strcat_P strcat
+#define strcmp_P strcmp
+
+// marks a flash string for print(), see F()
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(s))
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void noInterrupts();
+void interrupts();
+
+int digitalPinToInterrupt(uint8_t pin);
+void attachInterrupt(int interrupt, void (*handler)(), int mode);
+void detachInterrupt(int interrupt);
+
+class HardwareSerial {
+    public:
+        void begin(unsigned long baud);
+
+        size_t write(uint8_t c);
+        size_t write(const uint8_t* buffer, size_t size);
+        int availableForWrite();
+
+        size_t print(const __FlashStringHelper* s);
+        size_t print(const char* s);
+        size_t print(char c);
+        size_t print(int n, int base = DEC);
+        size_t print(unsigned int n, int base = DEC);
+        size_t print(long n, int base = DEC);
+        size_t print(unsigned long n, int base = DEC);
+        size_t print(double n, int digits = 2);
+
+        size_t println();
+        size_t println(const __FlashStringHelper* s);
+        size_t println(const char* s);
+        size_t println(char c);
+        size_t println(int n, int base = DEC);
+        size_t println(unsigned int n, int base = DEC);
+        size_t println(long n, int base = DEC);
+        size_t println(unsigned long n, int base = DEC);
+        size_t println(double n, int digits = 2);
+};
+
+extern HardwareSerial Serial;
+
+// ATmega328P Timer1, its registers are plain variables on the host
+#define F_CPU 16000000UL
+#define _BV(bit) (1 << (bit))
+
+extern volatile uint8_t TCCR1A;
+extern volatile uint8_t TCCR1B;
+extern volatile uint16_t TCNT1;
+extern volatile uint16_t ICR1;
+extern volatile uint16_t OCR1A;
+extern volatile uint16_t OCR1B;
+
+// TCCR1A
+#define COM1A1 7
+#define COM1A0 6
+#define COM1B1 5
+#define COM1B0 4
+#define WGM11 1
+#define WGM10 0
+
+// TCCR1B
+#define WGM13 4
+#define WGM12 3
+#define CS12 2
+#define CS11 1
+#define CS10 0
+
+#endif
@@ -0,0 +1,215 @@
+/*
+    DRV8704Sim.cpp - register level model of a DRV8704 for host builds
+
+    Created by REV for SEM.
+
+    ** see DRV8704Sim.h for full doc **
+
+*/
+#include <Arduino.h>
+#include "hostsim.h"
+#include "DRV8704Sim.h"
+
+const unsigned int DRV8704Sim::masks[8] = {
+    0xF01, // CTRL    DTIME, ISGAIN, ENBL
+    0x0FF, // TORQUE  TORQUE
+    0x1FF, // OFF     PWMMODE, TOFF
+    0x0FF, // BLANK   TBLANK
+    0x7FF, // DECAY   DECMOD, TDECAY
+    0x000, // RESERVED register
+    0xFFF, // DRIVE
+    0x03F, // STATUS  UVLO, BPDF, APDF, BOCP, AOCP, OTS
+};
+
+const unsigned int DRV8704Sim::defaults[8] = {
+    0x300, // CTRL    bridge disabled, ISGAIN 40
+    0x0FF, // TORQUE
+    0x030, // OFF
+    0x080, // BLANK
+    0x010, // DECAY
+    0x000, // RESERVED register
+    0xFA5, // DRIVE   IDRIVEP 200, IDRIVEN 400, TDRIVE 1050/1050, OCPDEG 2.1, OCPTH 500
+    0x000, // STATUS
+};
+
+DRV8704Sim::DRV8704Sim(uint8_t faultPin) {
+  _faultPin = faultPin;
+  _latency = 0;
+  _maxClock = 0;
+  _misoStuck = -1;
+  _glitchEvery = 0;
+  _readFrames = 0;
+  _glitch = false;
+  _sleepPin = 0xFF;
+  _wakeMicros = 0;
+  _sleepSeen = 0;
+  _awake = true;
+  resetCounters();
+  reset();
+}
+
+void DRV8704Sim::resetCounters() {
+  frames = 0;
+  reads = 0;
+  writes = 0;
+  errors = 0;
+  ignored = 0;
+}
+
+void DRV8704Sim::reset() {
+  for (int i = 0; i < 8; i++) {
+    _regs[i] = defaults[i];
+  }
+  _conditions = 0;
+  _frame = 0;
+  _bytes = 0;
+  updateFaultPin();
+}
+
+unsigned int DRV8704Sim::reg(unsigned int address) {
+  return _regs[address & 0x7];
+}
+
+void DRV8704Sim::setReg(unsigned int address, unsigned int value) {
+  _regs[address & 0x7] = value & masks[address & 0x7];
+  updateFaultPin();
+}
+
+void DRV8704Sim::raiseFault(unsigned int bits) {
+  _regs[7] |= bits & masks[7];
+  updateFaultPin();
+}
+
+void DRV8704Sim::setCondition(unsigned int bits, bool active) {
+  bits &= (OTS | UVLO);
+  if (active) {
+    _conditions |= bits;
+    _regs[7] |= bits;
+  } else {
+    _conditions &= ~bits;
+    _regs[7] &= ~bits; // auto clear
+  }
+  updateFaultPin();
+}
+
+void DRV8704Sim::setFrameLatency(unsigned long us) {
+  _latency = us;
+}
+
+void DRV8704Sim::setMaxClock(unsigned long hz) {
+  _maxClock = hz;
+}
+
+void DRV8704Sim::setMisoStuck(int level) {
+  _misoStuck = level;
+}
+
+void DRV8704Sim::setReadGlitch(unsigned long everyN) {
+  _glitchEvery = everyN;
+}
+
+void DRV8704Sim::setSleepPin(uint8_t pin, unsigned long wakeMicros) {
+  _sleepPin = pin;
+  _wakeMicros = wakeMicros;
+  _sleepSeen = pin != 0xFF ? hostsim::pinChangedAt(pin) : 0;
+}
+
+bool DRV8704Sim::checkSleep() {
+  if (_sleepPin == 0xFF) {
+    return true;
+  }
+  // any nSLEEP edge since the last frame means the chip went through sleep
+  unsigned long changed = hostsim::pinChangedAt(_sleepPin);
+  if (changed != _sleepSeen) {
+    _sleepSeen = changed;
+    for (int i = 0; i < 7; i++) {
+      _regs[i] = defaults[i];
+    }
+    _regs[7] = _conditions;
+    updateFaultPin();
+  }
+  return hostsim::pin(_sleepPin) == HIGH && hostsim::now() - changed >= _wakeMicros;
+}
+
+void DRV8704Sim::select(bool selected) {
+  if (selected) {
+    _frame = 0;
+    _bytes = 0;
+    _awake = checkSleep();
+    return;
+  }
+
+  // SCS falling edge ends the frame
+  if (!_awake) {
+    ignored += _bytes == 2;
+  } else if (_bytes == 2) {
+    latch(_frame);
+  } else if (_bytes != 0) {
+    errors++;
+  }
+  _bytes = 0;
+}
+
+uint8_t DRV8704Sim::exchange(uint8_t mosi) {
+  if (_maxClock && hostsim::spiClock() > _maxClock) {
+    mosi ^= 0x01; // too fast, last bit of each byte sampled wrong
+  }
+  _frame = ((_frame << 8) | mosi) & 0xFFFF;
+  _bytes++;
+
+  if (_misoStuck >= 0) {
+    return _misoStuck == HIGH ? 0xFF : 0x00;
+  }
+  if (_bytes == 1 && (mosi & 0x80)) {
+    _readFrames++;
+    _glitch = _glitchEvery && _readFrames % _glitchEvery == 0;
+  }
+  if (_glitch) {
+    _glitch = _bytes == 1;
+    return 0xFF;
+  }
+
+  if (!_awake) {
+    return 0;
+  }
+
+  if (_bytes == 1) {
+    // R/W and address are in the first byte, data starts on its low nibble
+    unsigned int address = (mosi >> 4) & 0x7;
+    return (mosi & 0x80) ? (_regs[address] >> 8) & 0x0F : 0;
+  }
+  if (_bytes == 2) {
+    unsigned int address = (_frame >> 12) & 0x7;
+    return (_frame & 0x8000) ? _regs[address] & 0xFF : 0;
+  }
+  return 0;
+}
+
+void DRV8704Sim::latch(unsigned int frame) {
+  unsigned int address = (frame >> 12) & 0x7;
+  unsigned int data = frame & 0xFFF;
+
+  frames++;
+  hostsim::advance(_latency);
+
+  if (frame & 0x8000) {
+    reads++;
+    return;
+  }
+  writes++;
+
+  if (address == 7) {
+    // writing 0 clears a latched fault, unless its condition is still active
+    unsigned int cleared = ~data & masks[7] & ~_conditions;
+    _regs[7] &= ~cleared;
+  } else {
+    _regs[address] = data & masks[address];
+  }
+  updateFaultPin();
+}
+
+void DRV8704Sim::updateFaultPin() {
+  if (_faultPin != 0xFF) {
+    hostsim::setPin(_faultPin, _regs[7] ? LOW : HIGH);
+  }
+}
@@ -0,0 +1,144 @@
+/*
+    DRV8704Sim.h - register level model of a DRV8704 for host builds
+
+    Created by REV for SEM.
+
+    Models the serial interface as drv uses it: 16 bit frames, MSB first,
+    bit 15 R/W (1 = read), bits 14-12 address, bits 11-0 data. Writes latch
+    when SCS drops after exactly 16 bits, reads return the register in the
+    low 12 bits of the same frame. Reserved bits read back as 0.
+
+    STATUS faults latch until a 0 is written to their bit. OTS and UVLO
+    clear themselves once their condition goes away, and can't be cleared
+    while it is active. nFAULT (active low) follows the STATUS bits.
+
+    With a sleep pin, nSLEEP low resets the registers to their power on
+    values and the serial interface ignores frames until wake time after
+    nSLEEP rises again.
+
+    Usage:
+    DRV8704Sim chip(FAULT);
+    hostsim::attach(&chip, SCS);
+    chip.setFrameLatency(20);
+    ... run drv code ...
+    chip.frames;
+
+*/
+#ifndef DRV8704Sim_h
+#define DRV8704Sim_h
+
+#include <Arduino.h>
+#include "hostsim.h"
+
+class DRV8704Sim : public SimDevice {
+    public:
+
+        // STATUS bits
+        static const unsigned int OTS = 0x01;
+        static const unsigned int AOCP = 0x02;
+        static const unsigned int BOCP = 0x04;
+        static const unsigned int APDF = 0x08;
+        static const unsigned int BPDF = 0x10;
+        static const unsigned int UVLO = 0x20;
+
+        // bits of each register that exist on the chip
+        static const unsigned int masks[8];
+
+        // power on values
+        static const unsigned int defaults[8];
+
+        /*
+        faultPin: pin driven as nFAULT (0xFF for none)
+        */
+        DRV8704Sim(uint8_t faultPin = 0xFF);
+
+        // frame counters
+        unsigned long frames;
+        unsigned long reads;
+        unsigned long writes;
+        unsigned long errors; // frames that weren't 16 bits long
+        unsigned long ignored; // frames sent while asleep or waking
+
+        void resetCounters();
+
+        /*
+        back to power on values, counters untouched
+        */
+        void reset();
+
+        /*
+        register contents, without going over the bus
+        */
+        unsigned int reg(unsigned int address);
+        void setReg(unsigned int address, unsigned int value);
+
+        /*
+        latches a STATUS fault (OTS, AOCP, ...)
+        */
+        void raiseFault(unsigned int bits);
+
+        /*
+        sets or removes an active OTS/UVLO condition
+        the fault stays latched while the condition is active
+        */
+        void setCondition(unsigned int bits, bool active);
+
+        /*
+        extra microseconds each frame holds the bus for, on top of the clock
+        */
+        void setFrameLatency(unsigned long us);
+
+        /*
+        above this SPI clock bits get corrupted (0 for no limit)
+        */
+        void setMaxClock(unsigned long hz);
+
+        /*
+        MISO held at level (LOW or HIGH) whatever the chip sends, -1 to release
+        */
+        void setMisoStuck(int level);
+
+        /*
+        every everyN-th read frame comes back as 0xFFFF (0 for never)
+        */
+        void setReadGlitch(unsigned long everyN);
+
+        /*
+        pin read as nSLEEP (0xFF for none, the chip never sleeps)
+        wakeMicros: time after nSLEEP rises before frames are accepted
+        */
+        void setSleepPin(uint8_t pin, unsigned long wakeMicros = 1000);
+
+        // SimDevice
+        void select(bool selected);
+        uint8_t exchange(uint8_t mosi);
+
+    private:
+
+        uint8_t _faultPin;
+        unsigned int _regs[8];
+        unsigned int _conditions;
+        unsigned long _latency;
+        unsigned long _maxClock;
+        int _misoStuck;
+        unsigned long _glitchEvery;
+        unsigned long _readFrames; // read frames started, for the glitch
+        bool _glitch;              // frame in progress is glitched
+        uint8_t _sleepPin;
+        unsigned long _wakeMicros;
+        unsigned long _sleepSeen; // pin change already acted on
+        bool _awake;              // frame in progress is accepted
+
+        unsigned int _frame;
+        unsigned char _bytes;
+
+        void latch(unsigned int frame);
+
+        /*
+        applies nSLEEP, returns false while asleep or waking
+        */
+        bool checkSleep();
+        void updateFaultPin();
+};
+
+#endif
@@ -0,0 +1,40 @@
+/*
+    EEPROM.h - host side stand-in for the Arduino EEPROM library
+
+    Created by REV for SEM.
+
+    1 KB like an ATmega328, erased (0xFF) by hostsim::reset.
+
+*/
+#ifndef EEPROM_h
+#define EEPROM_h
+
+#include <Arduino.h>
+
+#define EEPROM_SIZE 1024
+
+extern uint8_t eepromData[EEPROM_SIZE];
+
+class EEPROMClass {
+    public:
+        uint8_t read(int idx) { return eepromData[idx]; }
+        void write(int idx, uint8_t value) { eepromData[idx] = value; }
+        void update(int idx, uint8_t value) { eepromData[idx] = value; }
+        uint16_t length() { return EEPROM_SIZE; }
+
+        template <class T>
+        T& get(int idx, T& t) {
+            memcpy(&t, &eepromData[idx], sizeof(T));
+            return t;
+        }
+
+        template <class T>
+        const T& put(int idx, const T& t) {
+            memcpy(&eepromData[idx], &t, sizeof(T));
+            return t;
+        }
+};
+
+static EEPROMClass EEPROM __attribute__((unused));
+
+#endif
@@ -0,0 +1,46 @@
+/*
+    SPI.h - host side stand-in for the Arduino SPI library
+
+    Created by REV for SEM.
+
+    Frames are exchanged with the simulated device attached through
+    hostsim::attach (see hostsim.h).
+
+*/
+#ifndef SPI_h
+#define SPI_h
+
+#include <Arduino.h>
+
+#define MSBFIRST 1
+#define LSBFIRST 0
+
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x04
+#define SPI_MODE2 0x08
+#define SPI_MODE3 0x0C
+
+class SPISettings {
+    public:
+        SPISettings() : clock(4000000), bitOrder(MSBFIRST), dataMode(SPI_MODE0) {}
+        SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode)
+            : clock(clock), bitOrder(bitOrder), dataMode(dataMode) {}
+
+        uint32_t clock;
+        uint8_t bitOrder;
+        uint8_t dataMode;
+};
+
+class SPIClass {
+    public:
+        void begin();
+        void end();
+        void beginTransaction(SPISettings settings);
+        void endTransaction();
+        uint8_t transfer(uint8_t data);
+        uint16_t transfer16(uint16_t data);
+};
+
+extern SPIClass SPI;
+
+#endif
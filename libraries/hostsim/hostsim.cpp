@@ -0,0 +1,340 @@
+/*
+    hostsim.cpp - simulated time, pins and SPI peripheral for host builds
+
+    Created by REV for SEM.
+
+    ** see hostsim.h for full doc **
+
+*/
+#include <stdio.h>
+#include <stdarg.h>
+#include <string>
+#include <Arduino.h>
+#include <SPI.h>
+#include <EEPROM.h>
+#include "hostsim.h"
+
+HardwareSerial Serial;
+SPIClass SPI;
+uint8_t eepromData[EEPROM_SIZE];
+
+volatile uint8_t TCCR1A;
+volatile uint8_t TCCR1B;
+volatile uint16_t TCNT1;
+volatile uint16_t ICR1;
+volatile uint16_t OCR1A;
+volatile uint16_t OCR1B;
+
+static unsigned long simMicros = 0;
+static uint8_t pins[64];
+static unsigned long pinChanges[64];
+static int analogValues[64];
+
+// devices on the bus and their chip select pins
+static const int MAX_DEVICES = 8;
+static SimDevice* devices[MAX_DEVICES];
+static uint8_t devicePins[MAX_DEVICES];
+static int deviceCount = 0;
+
+static uint32_t busClock = 4000000;
+static void (*spiInterrupt)(uint8_t) = 0;
+static bool bytePending = false;
+static uint8_t byteOut = 0;
+
+static void (*pinInterrupts[64])() = {0};
+
+static bool serialCapture = false;
+static std::string serialBuffer;
+static unsigned long serialCount = 0;
+
+static void clockByte() {
+  // 8 clock periods per byte, rounded up to a whole microsecond
+  simMicros += (8000000UL + busClock - 1) / busClock;
+}
+
+static uint8_t exchange(uint8_t mosi) {
+  clockByte();
+  uint8_t miso = 0xFF; // nobody driving MISO
+  for (int i = 0; i < deviceCount; i++) {
+    if (pins[devicePins[i]] == HIGH) {
+      miso &= devices[i]->exchange(mosi); // open drain when two talk at once
+    }
+  }
+  return miso;
+}
+
+namespace hostsim {
+
+  void attach(SimDevice* dev, uint8_t selectPin) {
+    if (deviceCount < MAX_DEVICES) {
+      devices[deviceCount] = dev;
+      devicePins[deviceCount] = selectPin;
+      deviceCount++;
+    }
+  }
+
+  unsigned long now() {
+    return simMicros;
+  }
+
+  void advance(unsigned long us) {
+    simMicros += us;
+  }
+
+  void setPin(uint8_t p, uint8_t value) {
+    uint8_t old = pins[p];
+    pins[p] = value;
+    if (old != value) {
+      pinChanges[p] = simMicros;
+    }
+    if (pinInterrupts[p] && old != value) {
+      pinInterrupts[p]();
+    }
+  }
+
+  void setAnalog(uint8_t p, int value) {
+    analogValues[p] = value;
+  }
+
+  unsigned long pinChangedAt(uint8_t p) {
+    return pinChanges[p];
+  }
+
+  uint8_t pin(uint8_t p) {
+    return pins[p];
+  }
+
+  void setSpiInterrupt(void (*handler)(uint8_t)) {
+    spiInterrupt = handler;
+  }
+
+  uint32_t spiClock() {
+    return busClock;
+  }
+
+  void startByte(uint8_t data) {
+    byteOut = data;
+    bytePending = true;
+  }
+
+  bool pending() {
+    return bytePending;
+  }
+
+  bool step() {
+    if (!bytePending) {
+      return false;
+    }
+    bytePending = false;
+    uint8_t received = exchange(byteOut);
+    if (spiInterrupt) {
+      spiInterrupt(received); // may start the next byte
+    }
+    return true;
+  }
+
+  int run() {
+    int bytes = 0;
+    while (step()) {
+      bytes++;
+    }
+    return bytes;
+  }
+
+  void reset() {
+    simMicros = 0;
+    memset(pins, 0, sizeof(pins));
+    memset(pinChanges, 0, sizeof(pinChanges));
+    memset(analogValues, 0, sizeof(analogValues));
+    memset(pinInterrupts, 0, sizeof(pinInterrupts));
+    deviceCount = 0;
+    busClock = 4000000;
+    spiInterrupt = 0;
+    bytePending = false;
+    serialCapture = false;
+    serialBuffer.clear();
+    serialCount = 0;
+    memset(eepromData, 0xFF, sizeof(eepromData));
+    TCCR1A = TCCR1B = 0;
+    TCNT1 = ICR1 = OCR1A = OCR1B = 0;
+  }
+}
+
+// *** Arduino core ***
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (mode == INPUT_PULLUP) {
+    pins[pin] = HIGH;
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  uint8_t level = value ? HIGH : LOW;
+  bool changed = pins[pin] != level;
+  hostsim::setPin(pin, level);
+  for (int i = 0; i < deviceCount; i++) {
+    if (changed && devicePins[i] == pin) {
+      devices[i]->select(level == HIGH);
+    }
+  }
+}
+
+int digitalRead(uint8_t pin) {
+  return pins[pin];
+}
+
+int analogRead(uint8_t pin) {
+  return analogValues[pin];
+}
+
+unsigned long millis() {
+  return simMicros / 1000;
+}
+
+unsigned long micros() {
+  return simMicros;
+}
+
+void delay(unsigned long ms) {
+  simMicros += ms * 1000;
+}
+
+void delayMicroseconds(unsigned int us) {
+  simMicros += us;
+}
+
+void noInterrupts() {}
+
+void interrupts() {}
+
+int digitalPinToInterrupt(uint8_t pin) {
+  return pin < 64 ? pin : NOT_AN_INTERRUPT;
+}
+
+void attachInterrupt(int interrupt, void (*handler)(), int) {
+  pinInterrupts[interrupt] = handler;
+}
+
+void detachInterrupt(int interrupt) {
+  pinInterrupts[interrupt] = 0;
+}
+
+// *** Serial ***
+
+static size_t emit(const char* data, size_t size) {
+  serialCount += size;
+  if (serialCapture) {
+    serialBuffer.append(data, size);
+    return size;
+  }
+  return fwrite(data, 1, size, stdout);
+}
+
+static size_t emitf(const char* format, ...) {
+  char buffer[80];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if (length < 0) {
+    return 0;
+  }
+  return emit(buffer, (size_t)length < sizeof(buffer) ? length : sizeof(buffer) - 1);
+}
+
+namespace hostsim {
+
+  void captureSerial(bool capture) {
+    serialCapture = capture;
+  }
+
+  const std::string& serialOutput() {
+    return serialBuffer;
+  }
+
+  void clearSerial() {
+    serialBuffer.clear();
+  }
+
+  unsigned long serialBytes() {
+    return serialCount;
+  }
+}
+
+void HardwareSerial::begin(unsigned long) {}
+
+size_t HardwareSerial::write(uint8_t c) {
+  return emit((const char*)&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  return emit((const char*)buffer, size);
+}
+
+int HardwareSerial::availableForWrite() {
+  return 63;
+}
+
+size_t HardwareSerial::print(const __FlashStringHelper* s) { return print(reinterpret_cast<const char*>(s)); }
+size_t HardwareSerial::print(const char* s) { return emit(s, strlen(s)); }
+size_t HardwareSerial::print(char c) { return emit(&c, 1); }
+size_t HardwareSerial::print(int n, int base) { return print((long)n, base); }
+size_t HardwareSerial::print(unsigned int n, int base) { return print((unsigned long)n, base); }
+
+size_t HardwareSerial::print(long n, int base) {
+  if (base == DEC) {
+    return emitf("%ld", n);
+  }
+  return print((unsigned long)n, base);
+}
+
+size_t HardwareSerial::print(unsigned long n, int base) {
+  if (base == HEX) {
+    return emitf("%lX", n);
+  }
+  if (base == BIN) {
+    char buffer[8 * sizeof(n) + 1];
+    int i = sizeof(buffer) - 1;
+    buffer[i] = '\0';
+    do {
+      buffer[--i] = '0' + (n & 1);
+      n >>= 1;
+    } while (n);
+    return print(&buffer[i]);
+  }
+  return emitf("%lu", n);
+}
+
+size_t HardwareSerial::print(double n, int digits) { return emitf("%.*f", digits, n); }
+
+size_t HardwareSerial::println() { return emit("\r\n", 2); }
+size_t HardwareSerial::println(const __FlashStringHelper* s) { return print(s) + println(); }
+size_t HardwareSerial::println(const char* s) { return print(s) + println(); }
+size_t HardwareSerial::println(char c) { return print(c) + println(); }
+size_t HardwareSerial::println(int n, int base) { return print(n, base) + println(); }
+size_t HardwareSerial::println(unsigned int n, int base) { return print(n, base) + println(); }
+size_t HardwareSerial::println(long n, int base) { return print(n, base) + println(); }
+size_t HardwareSerial::println(unsigned long n, int base) { return print(n, base) + println(); }
+size_t HardwareSerial::println(double n, int digits) { return print(n, digits) + println(); }
+
+// *** SPI ***
+
+void SPIClass::begin() {}
+
+void SPIClass::end() {}
+
+void SPIClass::beginTransaction(SPISettings settings) {
+  busClock = settings.clock;
+}
+
+void SPIClass::endTransaction() {}
+
+uint8_t SPIClass::transfer(uint8_t data) {
+  return exchange(data);
+}
+
+uint16_t SPIClass::transfer16(uint16_t data) {
+  uint16_t high = exchange(data >> 8);
+  uint16_t low = exchange(data & 0xFF);
+  return (high << 8) | low;
+}
@@ -0,0 +1,114 @@
+/*
+    hostsim.h - simulated time, pins and SPI peripheral for host builds
+
+    Created by REV for SEM.
+
+    The SPI peripheral works like the AVR one: startByte() loads the data
+    register, the byte is exchanged with the attached device when the
+    simulation steps, and the registered interrupt handler is called with
+    the received byte (SPI_STC_vect on the board).
+
+    Usage:
+    MyDevice device;
+    hostsim::attach(&device, SCS_PIN);
+    hostsim::setSpiInterrupt(handler);
+    hostsim::startByte(0x80);
+    hostsim::run(); // steps until no byte is pending
+
+*/
+#ifndef hostsim_h
+#define hostsim_h
+
+#include <Arduino.h>
+#include <string>
+
+/*
+simulated SPI device, selected while its chip select pin is HIGH
+(the DRV8704's SCS is active high)
+*/
+class SimDevice {
+    public:
+        virtual ~SimDevice() {}
+
+        /*
+        called when chip select changes
+        */
+        virtual void select(bool selected) = 0;
+
+        /*
+        exchanges one byte, MSB first
+        returns the byte shifted out to MISO
+        */
+        virtual uint8_t exchange(uint8_t mosi) = 0;
+};
+
+namespace hostsim {
+
+    /*
+    attaches device to the bus, selected by pin (up to 8 devices)
+    */
+    void attach(SimDevice* device, uint8_t selectPin);
+
+    /*
+    current simulated time, advanced by delay() and bus traffic
+    */
+    unsigned long now();
+    void advance(unsigned long us);
+
+    /*
+    simulated pin levels (digitalRead of an INPUT pin returns what was set here)
+    */
+    void setPin(uint8_t pin, uint8_t value);
+    uint8_t pin(uint8_t pin);
+
+    /*
+    value analogRead returns for pin (0-1023)
+    */
+    void setAnalog(uint8_t pin, int value);
+
+    /*
+    simulated time of the pin's last level change (0 if it never changed)
+    */
+    unsigned long pinChangedAt(uint8_t pin);
+
+    /*
+    interrupt driven peripheral
+    */
+    void setSpiInterrupt(void (*handler)(uint8_t received));
+
+    /*
+    clock of the current SPI transaction in Hz
+    */
+    uint32_t spiClock();
+    void startByte(uint8_t data);
+    bool pending();
+
+    /*
+    completes the pending byte, returns false if nothing was pending
+    */
+    bool step();
+
+    /*
+    steps until no byte is pending, returns the number of bytes exchanged
+    */
+    int run();
+
+    /*
+    Serial output goes to stdout unless captured
+    */
+    void captureSerial(bool capture);
+    const std::string& serialOutput();
+    void clearSerial();
+
+    /*
+    bytes written to Serial since reset, captured or not
+    */
+    unsigned long serialBytes();
+
+    /*
+    clears pins, time, Serial, Timer1 and the attached devices, erases the EEPROM
+    */
+    void reset();
+}
+
+#endif
@@ -0,0 +1,114 @@
+/*
+    asynccheck.cpp - checks drvAsync's request queue against the simulated DRV8704
+
+    Created by REV for SEM.
+
+    Runs the interrupt driven engine on hostsim's SPI peripheral: filling
+    and overflowing the queue, completion order, results, callbacks and
+    shadow updates, and a read frame failing its check (MISO stuck high),
+    which must complete with BAD_FRAME and leave the shadow alone.
+    Prints one line per check and exits non zero if any failed.
+
+    Build (host):
+    g++ -std=gnu++11 -DDRV_HOST_SIM -Ilibraries/hostsim -Ilibraries/drv -Ilibraries/Logger \
+        -Ilibraries/drvAsync \
+        tools/asynccheck/asynccheck.cpp libraries/hostsim/hostsim.cpp libraries/hostsim/DRV8704Sim.cpp \
+        libraries/drv/drv.cpp libraries/Logger/Logger.cpp libraries/drvAsync/drvAsync.cpp -o asynccheck
+
+    Usage:
+    asynccheck
+
+*/
+#include <stdio.h>
+#include "hostsim.h"
+#include "DRV8704Sim.h"
+#include "drv.h"
+#include "drvAsync.h"
+
+#define SCS 8
+
+static int failures = 0;
+
+static void check(const char* name, bool passed) {
+  printf("%s,%s\n", passed ? "ok" : "FAIL", name);
+  if (!passed) {
+    failures++;
+  }
+}
+
+// completions in callback order, address << 12 | value
+static unsigned int completions[16];
+static int completed = 0;
+
+static void onComplete(unsigned int address, unsigned int value, void*) {
+  if (completed < 16) {
+    completions[completed] = (address << 12) | (value & 0xFFF);
+  }
+  completed++;
+}
+
+int main() {
+  DRV8704Sim chip;
+  hostsim::attach(&chip, SCS);
+
+  drv device(11, 12, 13, SCS);
+  hostsim::captureSerial(true); // logging isn't what is checked
+  device.syncRegisters();
+
+  drvAsync engine(device);
+  engine.begin();
+  check("idle after begin", !engine.busy() && engine.pending() == 0);
+
+  // fill the queue, one more is refused
+  unsigned int tickets[drvAsync::QUEUE_SIZE];
+  bool queued = true;
+  for (unsigned int i = 0; i < drvAsync::QUEUE_SIZE; i++) {
+    unsigned int address = i % 2 ? device.BLANK : device.TORQUE;
+    queued = queued && engine.submitWrite(address, 0x10 + i, onComplete, NULL, &tickets[i]);
+  }
+  check("queue fills", queued && engine.pending() == drvAsync::QUEUE_SIZE && engine.busy());
+  check("full queue refuses", !engine.submitRead(device.CTRL));
+  check("nothing done before the bus runs", !engine.done(tickets[0]));
+
+  // completion, in submission order
+  hostsim::run();
+  bool inOrder = completed == drvAsync::QUEUE_SIZE;
+  for (unsigned int i = 0; i < drvAsync::QUEUE_SIZE && inOrder; i++) {
+    unsigned int address = i % 2 ? device.BLANK : device.TORQUE;
+    inOrder = completions[i] == ((address << 12) | (0x10 + i)) && engine.done(tickets[i])
+              && engine.result(tickets[i]) == 0x10 + i;
+  }
+  check("writes complete in order", inOrder);
+  check("idle after the queue drains", !engine.busy() && engine.pending() == 0);
+  check("writes reach chip and shadow", chip.reg(1) == 0x16 && device.cached(1) == 0x16
+        && chip.reg(3) == 0x17 && device.cached(3) == 0x17);
+
+  // reads return the chip's value and refresh the shadow
+  unsigned int ticket;
+  chip.setReg(2, 0x0A5);
+  unsigned long frames = device.frameCount;
+  engine.submitRead(device.OFF, NULL, NULL, &ticket);
+  hostsim::run();
+  check("read completes", engine.done(ticket) && engine.result(ticket) == 0x0A5 && device.cached(2) == 0x0A5);
+  check("read counts one frame", device.frameCount - frames == 1);
+
+  // a read that fails its check
+  unsigned int errors = device.regErrors[2];
+  chip.setMisoStuck(HIGH);
+  completed = 0;
+  engine.submitRead(device.OFF, onComplete, NULL, &ticket);
+  hostsim::run();
+  chip.setMisoStuck(-1);
+  check("bad read completes with BAD_FRAME", engine.done(ticket) && engine.result(ticket) == drvAsync::BAD_FRAME
+        && completed == 1);
+  check("bad read counted", device.regErrors[2] == errors + 1);
+  check("bad read leaves the shadow", device.cached(2) == 0x0A5);
+
+  // the engine keeps going after an error
+  engine.submitRead(device.OFF, NULL, NULL, &ticket);
+  hostsim::run();
+  check("read after error", engine.done(ticket) && engine.result(ticket) == 0x0A5 && !engine.busy());
+
+  printf("%d failed\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,195 @@
+/*
+    isrcheck.cpp - checks drv's ISR safe calls against the simulated DRV8704
+
+    Created by REV for SEM.
+
+    Trips the bridge with isrTrip, then drives every path that can write
+    CTRL (each setter, applyProfile, raw write, batches, wake, the torque
+    stream, drvBus and drvAsync) and checks that ENBL stays off on the
+    chip and in the shadow until clearTrip, and that readbacks of the
+    gated frames pass. Also checks isrTorque,
+    isrBridge and isrStatus, with a faulted chip and with MISO stuck high.
+    Prints one line per check and exits non zero if any failed.
+
+    Build (host):
+    g++ -std=gnu++11 -DDRV_HOST_SIM -Ilibraries/hostsim -Ilibraries/drv -Ilibraries/Logger \
+        -Ilibraries/drvBus -Ilibraries/drvAsync \
+        tools/isrcheck/isrcheck.cpp libraries/hostsim/hostsim.cpp libraries/hostsim/DRV8704Sim.cpp \
+        libraries/drv/drv.cpp libraries/Logger/Logger.cpp libraries/drvBus/drvBus.cpp \
+        libraries/drvAsync/drvAsync.cpp -o isrcheck
+
+    Usage:
+    isrcheck
+
+*/
+#include <stdio.h>
+#include "hostsim.h"
+#include "DRV8704Sim.h"
+#include "drv.h"
+#include "drvBus.h"
+#include "drvAsync.h"
+
+#define SCS 8
+#define SLEEP 4
+
+static int failures = 0;
+
+static void check(const char* name, bool passed) {
+  printf("%s,%s\n", passed ? "ok" : "FAIL", name);
+  if (!passed) {
+    failures++;
+  }
+}
+
+// ENBL off on the chip and in the shadow
+static bool bridgeOff(DRV8704Sim& chip, drv& device) {
+  return (chip.reg(0) & 0x001) == 0 && (device.cached(device.CTRL) & 0x001) == 0;
+}
+
+// paths that write CTRL, each tries to turn the bridge on
+static void viaHbridge(drv& device) { device.setHbridge(Bridge::On); }
+static void viaISGain(drv& device) { device.setISGain(ISGain::V20); }
+static void viaDTime(drv& device) { device.setDTime(DeadTime::Ns460); }
+static void viaTorque(drv& device) { device.setTorque(0x40); }
+static void viaTOff(drv& device) { device.setTOff(0x20); }
+static void viaTBlank(drv& device) { device.setTBlank(0x90); }
+static void viaTDecay(drv& device) { device.setTDecay(0x20); }
+static void viaDecMode(drv& device) { device.setDecMode(Decay::Mixed); }
+static void viaOCPThresh(drv& device) { device.setOCPThresh(OCPThreshold::Mv750); }
+static void viaOCPDeglitch(drv& device) { device.setOCPDeglitchTime(OCPDeglitch::Us4_2); }
+static void viaTDriveN(drv& device) { device.setTDriveN(GateDriveTime::Ns525); }
+static void viaTDriveP(drv& device) { device.setTDriveP(GateDriveTime::Ns525); }
+static void viaIDriveN(drv& device) { device.setIDriveN(SinkCurrent::Ma200); }
+static void viaIDriveP(drv& device) { device.setIDriveP(SourceCurrent::Ma100); }
+static void viaField(drv& device) { device.set<drvFields::ENBL>(1); }
+static void viaWrite(drv& device) { device.write(device.CTRL, 0x301); }
+
+static void viaBatch(drv& device) {
+  device.beginBatch();
+  device.queueWrite(device.CTRL, 0x201);
+  device.queueRead(device.CTRL);
+  device.runBatch();
+}
+
+static void viaProfile(drv& device) {
+  DrvProfile profile = DRV_DEFAULT_PROFILE;
+  profile.enable = true;
+  device.applyProfile(profile);
+}
+
+static void viaWake(drv& device) {
+  device.set<drvFields::ENBL>(1);
+  device.sleep();
+  device.wake(true);
+}
+
+struct Path {
+  const char* name;
+  void (*run)(drv& device);
+};
+
+static const Path paths[] = {
+  {"trip setHbridge", viaHbridge}, {"trip setISGain", viaISGain}, {"trip setDTime", viaDTime},
+  {"trip setTorque", viaTorque}, {"trip setTOff", viaTOff}, {"trip setTBlank", viaTBlank},
+  {"trip setTDecay", viaTDecay}, {"trip setDecMode", viaDecMode}, {"trip setOCPThresh", viaOCPThresh},
+  {"trip setOCPDeglitchTime", viaOCPDeglitch}, {"trip setTDriveN", viaTDriveN},
+  {"trip setTDriveP", viaTDriveP}, {"trip setIDriveN", viaIDriveN}, {"trip setIDriveP", viaIDriveP},
+  {"trip set<ENBL>", viaField}, {"trip write", viaWrite}, {"trip batch", viaBatch},
+  {"trip applyProfile", viaProfile}, {"trip wake", viaWake}
+};
+
+int main() {
+  DRV8704Sim chip;
+  hostsim::attach(&chip, SCS);
+  chip.setSleepPin(SLEEP);
+
+  drv device(11, 12, 13, SCS);
+  device.setSleepPin(SLEEP);
+  delayMicroseconds(drv::WAKE_MICROS); // the chip ignores frames while it wakes
+  hostsim::captureSerial(true); // logging isn't what is checked
+  device.syncRegisters();
+  check("shadow seeded", chip.ignored == 0 && device.cached(device.DRIVE) == chip.reg(device.DRIVE));
+
+  // every path, from a running bridge
+  for (unsigned int i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+    device.clearTrip();
+    device.setHbridge(Bridge::On);
+    device.isrTrip();
+    paths[i].run(device);
+    check(paths[i].name, device.tripped() && bridgeOff(chip, device));
+  }
+
+  // torque stream held open across the trip
+  device.clearTrip();
+  device.setHbridge(Bridge::On);
+  device.armTorqueStream();
+  device.isrTrip();
+  device.streamTorque(0x55);
+  device.disarmTorqueStream();
+  check("trip torque stream", bridgeOff(chip, device) && chip.reg(1) == 0x55);
+
+  // drvBus broadcasts
+  drvBus bus;
+  bus.attach(device);
+  device.clearTrip();
+  device.setHbridge(Bridge::On);
+  device.isrTrip();
+  bus.broadcast(device.CTRL, 0x301);
+  bus.broadcast<drvFields::ENBL>(1);
+  check("trip drvBus", bridgeOff(chip, device));
+
+  // drvAsync, queued after the trip (an isr frame can't land inside its frames)
+  drvAsync engine(device);
+  engine.begin();
+  device.clearTrip();
+  device.setHbridge(Bridge::On);
+  device.isrTrip();
+  engine.submitWrite(device.CTRL, 0x301);
+  hostsim::run();
+  check("trip drvAsync", bridgeOff(chip, device));
+
+  // readbacks expect what the chip was sent, CTRL without ENBL
+  device.setReliability(2, 20, 1, 3);
+  device.setVerifyPolicy(drv::VERIFY_EVERY_N, 1);
+  device.clearTrip();
+  device.setHbridge(Bridge::On);
+  device.isrTrip();
+  unsigned int failed = device.busFailures;
+  bool setOk = device.setHbridge(Bridge::On);
+  DrvProfile profile = DRV_DEFAULT_PROFILE;
+  profile.isGain = 20;
+  bool profileOk = device.applyProfile(profile);
+  check("trip readback", setOk && profileOk && device.busFailures == failed && bridgeOff(chip, device));
+  device.setReliability(2, 20, 0, 3);
+
+  // the latch lets go only on clearTrip
+  device.clearTrip();
+  check("clearTrip keeps bridge off", !device.tripped() && bridgeOff(chip, device));
+  device.setHbridge(Bridge::On);
+  check("bridge on after clearTrip", (chip.reg(0) & 0x001) == 1);
+
+  // plain isr writes
+  unsigned long frames = device.frameCount;
+  device.isrTorque(0x80);
+  check("isrTorque one frame", device.frameCount - frames == 1 && chip.reg(1) == 0x80 && device.cached(1) == 0x80);
+  device.isrBridge(false);
+  check("isrBridge off", bridgeOff(chip, device) && (chip.reg(0) & 0xF00) == (device.cached(0) & 0xF00));
+  check("isrBridge on", device.isrBridge(true) && (chip.reg(0) & 0x001) == 1);
+  device.isrTrip();
+  check("isrBridge on refused while tripped", !device.isrBridge(true) && bridgeOff(chip, device));
+  device.clearTrip();
+
+  // STATUS
+  check("isrStatus clear", device.isrStatus() == 0);
+  chip.raiseFault(DRV8704Sim::AOCP);
+  check("isrStatus fault", device.isrStatus() == DRV8704Sim::AOCP && device.cached(device.STATUS) == DRV8704Sim::AOCP);
+  unsigned int errors = device.regErrors[7];
+  chip.setMisoStuck(HIGH);
+  int stuck = device.isrStatus();
+  chip.setMisoStuck(-1);
+  check("isrStatus MISO stuck high", stuck == -1 && device.regErrors[7] == errors + 1
+        && device.cached(device.STATUS) == DRV8704Sim::AOCP);
+
+  printf("%d failed\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,145 @@
+/*
+    logdecode.cpp - turns Logger binary records back into text lines
+
+    Created by REV for SEM.
+
+    Reads a captured serial stream (binary transport, see Logger.h) and
+    prints each record the way the text transport would have. Bytes outside
+    records are copied through, so text printed before switching transport
+    survives.
+
+    Build (host):
+    g++ -Ilibraries/hostsim -Ilibraries/Logger -Ilibraries/drv tools/logdecode/logdecode.cpp -o logdecode
+
+    Usage:
+    logdecode [-t] [capture.bin]
+        -t  prefix every record with its timestamp in microseconds
+        reads stdin if no file is given
+
+*/
+#include <stdio.h>
+#include <string.h>
+#include "Logger.h"
+#include "drvFields.h"
+
+// tag ids, as passed to the Logger constructors
+static const char* tagName(unsigned char id) {
+  static char unknown[12];
+  if (id == 0) {
+    return "DRV8704";
+  }
+  snprintf(unknown, sizeof(unknown), "TAG%u", id);
+  return unknown;
+}
+
+static bool readBytes(FILE* in, unsigned char* buffer, size_t length) {
+  return fread(buffer, 1, length, in) == length;
+}
+
+static unsigned long little(const unsigned char* bytes) {
+  return (unsigned long)bytes[0] | ((unsigned long)bytes[1] << 8) |
+         ((unsigned long)bytes[2] << 16) | ((unsigned long)bytes[3] << 24);
+}
+
+static void printSet(const unsigned char* record, bool success) {
+  unsigned char reg = record[0];
+  unsigned char field = record[1];
+  unsigned char format = record[2];
+  long value = (long)(int32_t)little(&record[3]);
+
+  printf("%s register, ", reg < 8 ? drvFields::registerNames[reg] : "?");
+  printf("%s subregister, ", field < drvFields::FIELD_COUNT ? drvFields::fieldNames[field] : "?");
+
+  // a corrupt record can carry any value, only in range ones are looked up
+  if (format == LOG_NAME && field < drvFields::FIELD_COUNT && drvFields::valueNames[field] != NULL
+      && value >= 0 && value < drvFields::valueNameCounts[field]) {
+    printf("%s", drvFields::valueNames[field][value]);
+  } else if (format == LOG_MILLI) {
+    printf("%.2f", value / 1000.0);
+  } else {
+    printf("%ld", value);
+  }
+  printf(success ? " write success\n" : " write fail\n");
+}
+
+static void printRegister(const unsigned char* record, unsigned long time) {
+  unsigned char reg = record[0];
+  unsigned char source = record[1];
+  unsigned int oldValue = record[2] | (record[3] << 8);
+  unsigned int newValue = record[4] | (record[5] << 8);
+
+  printf("%s register %s by %s, 0x%X -> 0x%X at %lu us\n",
+         drvFields::registerNames[reg & 0x7], reg & 0x80 ? "read" : "write",
+         source < drvFields::SOURCE_COUNT ? drvFields::sourceNames[source] : "?",
+         oldValue, newValue, time);
+}
+
+int main(int argc, char** argv) {
+  bool timestamps = false;
+  FILE* in = stdin;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-t") == 0) {
+      timestamps = true;
+    } else if ((in = fopen(argv[i], "rb")) == NULL) {
+      perror(argv[i]);
+      return 1;
+    }
+  }
+
+  int c;
+  while ((c = fgetc(in)) != EOF) {
+    if (c != LOG_SYNC) {
+      putchar(c);
+      continue;
+    }
+
+    unsigned char start[6]; // event, timestamp, tag id
+    if (!readBytes(in, start, sizeof(start))) {
+      break;
+    }
+    unsigned char event = start[0];
+
+    if (timestamps) {
+      printf("[%lu] ", little(&start[1]));
+    }
+    printf("%s", tagName(start[5]));
+
+    if (event == LOG_EVENT_SET || event == LOG_EVENT_SET_FAIL) {
+      unsigned char record[7];
+      if (!readBytes(in, record, sizeof(record))) {
+        break;
+      }
+      printf(event == LOG_EVENT_SET ? " - INFO: " : " - ERROR: ");
+      printSet(record, event == LOG_EVENT_SET);
+    } else if (event == LOG_EVENT_INFO || event == LOG_EVENT_ERROR || event == LOG_EVENT_GLOBAL) {
+      int length = fgetc(in);
+      char message[256];
+      if (length == EOF || !readBytes(in, (unsigned char*)message, length)) {
+        break;
+      }
+      message[length] = '\0';
+      printf(event == LOG_EVENT_INFO ? " - INFO: " : event == LOG_EVENT_ERROR ? " - ERROR: " : " - GLOBAL: ");
+      printf("%s\n", message);
+    } else if (event == LOG_EVENT_REGISTER) {
+      unsigned char record[6];
+      if (!readBytes(in, record, sizeof(record))) {
+        break;
+      }
+      printf(" - GLOBAL: ");
+      printRegister(record, little(&start[1]));
+    } else if (event == LOG_EVENT_FRAME) {
+      // subsystem data, see tools/telemetry for drvTelemetry frames
+      int length = fgetc(in);
+      unsigned char data[256];
+      if (length == EOF || !readBytes(in, data, length)) {
+        break;
+      }
+      printf(" - FRAME: %c, %d bytes\n", length > 0 ? data[0] : '?', length);
+    } else {
+      printf(" - unknown record %u\n", event);
+    }
+  }
+
+  return 0;
+}
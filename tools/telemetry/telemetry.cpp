@@ -0,0 +1,161 @@
+/*
+    telemetry.cpp - turns drvTelemetry frames into CSV
+
+    Created by REV for SEM.
+
+    Reads a captured serial stream, picks out the drvTelemetry frame
+    records (see drvTelemetry.h), checks their CRC, applies the deltas and
+    prints one CSV row per frame. Logger records and text around them are
+    skipped. A delta that follows a sequence gap or a bad frame is dropped
+    until the next key frame. Counts of frames, CRC errors and dropped
+    deltas go to stderr at the end.
+
+    Build (host):
+    g++ -Ilibraries/hostsim -Ilibraries/Logger -Ilibraries/drv -Ilibraries/drvScheduler -Ilibraries/drvTelemetry tools/telemetry/telemetry.cpp -o telemetry
+
+    Usage:
+    telemetry [capture.bin] > telemetry.csv
+        reads stdin if no file is given
+
+*/
+#include <stdio.h>
+#include <string.h>
+#include "Logger.h"
+#include "drvTelemetry.h"
+
+// STATUS fault bits, LSB first
+static const char* faultNames[6] = {"OTS", "AOCP", "BOCP", "APDF", "BPDF", "UVLO"};
+
+static bool readBytes(FILE* in, unsigned char* buffer, size_t length) {
+  return fread(buffer, 1, length, in) == length;
+}
+
+static unsigned long little(const unsigned char* bytes, unsigned char size) {
+  unsigned long value = 0;
+  for (unsigned char i = 0; i < size; i++) {
+    value |= (unsigned long)bytes[i] << (8 * i);
+  }
+  return value;
+}
+
+static void printHeader() {
+  printf("time_us,ctrl,torque,off,blank,decay,drive,status,faults,fault_names,"
+         "frames,verify_errors,stream_errors,bus_retries,bus_failures,reg_errors,"
+         "overruns,loop_max_us,loop_late_us,sequence,key\n");
+}
+
+static void printRow(const unsigned long* fields, unsigned char sequence, bool key) {
+  printf("%lu", fields[TELEMETRY_TIME]);
+  for (int f = TELEMETRY_CTRL; f <= TELEMETRY_STATUS; f++) {
+    printf(",0x%03lX", fields[f]);
+  }
+  printf(",0x%02lX,", fields[TELEMETRY_FAULTS]);
+  bool first = true;
+  for (int bit = 0; bit < 6; bit++) {
+    if (fields[TELEMETRY_FAULTS] & (1 << bit)) {
+      printf("%s%s", first ? "" : "|", faultNames[bit]);
+      first = false;
+    }
+  }
+  for (int f = TELEMETRY_FRAMES; f < TELEMETRY_FIELDS; f++) {
+    printf(",%lu", fields[f]);
+  }
+  printf(",%u,%d\n", sequence, key ? 1 : 0);
+}
+
+int main(int argc, char** argv) {
+  FILE* in = stdin;
+  if (argc > 1 && (in = fopen(argv[1], "rb")) == NULL) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  unsigned long fields[TELEMETRY_FIELDS] = {0};
+  bool synced = false;
+  unsigned char expected = 0;
+  unsigned long frames = 0;
+  unsigned long crcErrors = 0;
+  unsigned long dropped = 0;
+
+  printHeader();
+
+  int c;
+  while ((c = fgetc(in)) != EOF) {
+    if (c != LOG_SYNC) {
+      continue;
+    }
+
+    // event, timestamp, tag id
+    unsigned char start[6];
+    if (!readBytes(in, start, sizeof(start))) {
+      break;
+    }
+    unsigned char event = start[0];
+
+    unsigned char data[256];
+    if (event == LOG_EVENT_SET || event == LOG_EVENT_SET_FAIL) {
+      if (!readBytes(in, data, 7)) {
+        break;
+      }
+      continue;
+    } else if (event == LOG_EVENT_REGISTER) {
+      if (!readBytes(in, data, 6)) {
+        break;
+      }
+      continue;
+    } else if (event != LOG_EVENT_INFO && event != LOG_EVENT_ERROR &&
+               event != LOG_EVENT_GLOBAL && event != LOG_EVENT_FRAME) {
+      continue; // not a record, look for the next sync byte
+    }
+
+    int length = fgetc(in);
+    if (length == EOF || !readBytes(in, data, length)) {
+      break;
+    }
+    if (event != LOG_EVENT_FRAME || length < 4 + TELEMETRY_MASK_SIZE || data[0] != TELEMETRY_ID) {
+      continue;
+    }
+
+    if (telemetryCrc(data, length - 2) != little(&data[length - 2], 2)) {
+      crcErrors++;
+      synced = false;
+      continue;
+    }
+
+    unsigned char sequence = data[1];
+    unsigned long mask = little(&data[2], TELEMETRY_MASK_SIZE);
+    bool key = mask == TELEMETRY_KEY;
+    if (!key && (!synced || sequence != expected)) {
+      dropped++;
+      synced = false;
+      continue;
+    }
+
+    // fields present in the mask, in order
+    int at = 2 + TELEMETRY_MASK_SIZE;
+    bool fits = true;
+    for (int f = 0; f < TELEMETRY_FIELDS && fits; f++) {
+      if (mask & (1UL << f)) {
+        unsigned char size = pgm_read_byte(&telemetrySizes[f]);
+        fits = at + size <= length - 2;
+        if (fits) {
+          fields[f] = little(&data[at], size);
+          at += size;
+        }
+      }
+    }
+    if (!fits) {
+      crcErrors++;
+      synced = false;
+      continue;
+    }
+
+    synced = true;
+    expected = sequence + 1;
+    frames++;
+    printRow(fields, sequence, key);
+  }
+
+  fprintf(stderr, "%lu frames, %lu CRC errors, %lu deltas dropped\n", frames, crcErrors, dropped);
+  return 0;
+}